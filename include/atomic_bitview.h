@@ -0,0 +1,209 @@
+/*
+ * Copyright 2014 Nicola Gigante
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PACKED_BITVECTOR_ATOMIC_BITVIEW_H
+#define PACKED_BITVECTOR_ATOMIC_BITVIEW_H
+
+#include "bitview.h"
+#include "internal/bits.h"
+#include "internal/atomic.h"
+
+#include <atomic>
+
+namespace bv
+{
+    namespace internal {
+        
+        /*
+         * Lock-free access to the bits of a bitview from many threads,
+         * e.g. to mark the visited nodes in a parallel graph traversal.
+         * The bitview is referenced and not copied, and it must not be
+         * resized while in use. Its words must be stored as lvalues, as in
+         * std::vector or std::deque, and they must not be accessed other
+         * than through atomic_bitview while threads use it.
+         *
+         * Each operation takes a std::memory_order, sequentially consistent
+         * by default. To only mark bits, std::memory_order_relaxed suffices.
+         */
+        template<template<typename ...> class Container,
+                 typename Word = uint64_t>
+        class atomic_bitview
+        {
+            static_assert(is_always_lock_free<Word>(),
+                          "Atomic operations on the words must be lock-free");
+        
+        public:
+            using word_type = Word;
+            
+            static constexpr size_t W = bitsize<word_type>();
+            
+            explicit atomic_bitview(bitview<Container, Word> &bits)
+                : _bits(&bits) { }
+            
+            bitview<Container, Word> &bits() const { return *_bits; }
+            
+            size_t size() const { return _bits->size(); }
+            
+            bool test(size_t index,
+                      std::memory_order order = std::memory_order_seq_cst) const
+            {
+                assert(index < size());
+                return (load_word(index / W, order) & bit(index)) != 0;
+            }
+            
+            void set(size_t index,
+                     std::memory_order order = std::memory_order_seq_cst)
+            {
+                assert(index < size());
+                fetch_or(index / W, bit(index), order);
+            }
+            
+            void reset(size_t index,
+                       std::memory_order order = std::memory_order_seq_cst)
+            {
+                assert(index < size());
+                fetch_and(index / W, word_type(~bit(index)), order);
+            }
+            
+            /*
+             * Set or reset the bit, returning its previous value, so only one
+             * of many threads racing on the same bit sees it changing.
+             * The bit is read before, to not dirty the cache line in the
+             * common case where it's already set, or reset.
+             */
+            bool test_and_set(size_t index,
+                              std::memory_order order =
+                                  std::memory_order_seq_cst);
+            
+            bool test_and_reset(size_t index,
+                                std::memory_order order =
+                                    std::memory_order_seq_cst);
+            
+            /*
+             * Atomic operations on whole words, given by index.
+             * The fetch functions return the previous value of the word.
+             */
+            word_type load_word(size_t i,
+                                std::memory_order order =
+                                    std::memory_order_seq_cst) const
+            {
+                return atomic_load(word(i), order);
+            }
+            
+            word_type fetch_or(size_t i, word_type mask,
+                               std::memory_order order =
+                                   std::memory_order_seq_cst)
+            {
+                return atomic_fetch_or(word(i), mask, order);
+            }
+            
+            word_type fetch_and(size_t i, word_type mask,
+                                std::memory_order order =
+                                    std::memory_order_seq_cst)
+            {
+                return atomic_fetch_and(word(i), mask, order);
+            }
+            
+            /*
+             * Number of set bits in [begin, end), reading each word with a
+             * relaxed load. It's not a snapshot while other threads are
+             * writing: each word is counted as it was when it was read, so
+             * if the writes only set bits, or only reset them, the result is
+             * between the counts before and after the writes, but with both
+             * it can be outside that range, e.g. when a bit is set in a word
+             * already read and another is reset in one not read yet.
+             */
+            size_t popcount(size_t begin, size_t end) const;
+            
+            size_t popcount() const { return popcount(0, size()); }
+        
+        private:
+            static word_type bit(size_t index) {
+                return word_type(1) << (index % W);
+            }
+            
+            word_type &word(size_t i) const {
+                assert(i < _bits->container().size());
+                return _bits->container()[i];
+            }
+        
+        private:
+            bitview<Container, Word> *_bits;
+        };
+        
+        template<template<typename ...> class C, typename Word>
+        bool atomic_bitview<C, Word>::test_and_set(size_t index,
+                                                   std::memory_order order)
+        {
+            assert(index < size());
+            
+            word_type mask = bit(index);
+            
+            if(load_word(index / W, order) & mask)
+                return true;
+            
+            return (fetch_or(index / W, mask, order) & mask) != 0;
+        }
+        
+        template<template<typename ...> class C, typename Word>
+        bool atomic_bitview<C, Word>::test_and_reset(size_t index,
+                                                     std::memory_order order)
+        {
+            assert(index < size());
+            
+            word_type mask = bit(index);
+            
+            if(!(load_word(index / W, order) & mask))
+                return false;
+            
+            return (fetch_and(index / W, word_type(~mask), order) & mask) != 0;
+        }
+        
+        template<template<typename ...> class C, typename Word>
+        size_t atomic_bitview<C, Word>::popcount(size_t begin,
+                                                 size_t end) const
+        {
+            if(is_empty_range(begin, end))
+                return 0;
+            
+            check_valid_range(begin, end, size());
+            
+            size_t first = begin / W;
+            size_t last  = (end - 1) / W;
+            
+            size_t result = 0;
+            for(size_t i = first; i <= last; ++i)
+            {
+                word_type w = load_word(i, std::memory_order_relaxed);
+                
+                if(i == last)
+                    w = lowbits(w, end - last * W);
+                if(i == first)
+                    w = highbits(w, W - begin % W);
+                
+                result += internal::popcount(w);
+            }
+            
+            return result;
+        }
+    
+    } // namespace internal
+    
+    // Public things
+    using internal::atomic_bitview;
+} // namespace bv
+
+#endif
@@ -0,0 +1,401 @@
+/*
+ * Copyright 2014 Nicola Gigante
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PACKED_BITVECTOR_ATOMIC_PACKED_VIEW_H
+#define PACKED_BITVECTOR_ATOMIC_PACKED_VIEW_H
+
+#include "packed_view.h"
+#include "internal/bits.h"
+#include "internal/atomic.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+namespace bv
+{
+    namespace internal {
+        
+        /*
+         * Lock-free arithmetic on the fields of a packed_view from many
+         * threads, e.g. to update an array of small counters.
+         * As for atomic_bitview, the packed_view is referenced and not
+         * copied, it must not be resized while in use, and its words must
+         * be stored as lvalues and not accessed other than from here.
+         *
+         * A field inside a word is updated with a compare-and-swap loop on
+         * the word. A field straddling two words is updated under one of a
+         * few spinlocks, chosen by the position of the field, writing each
+         * half with a compare-and-swap so the other fields of the two words
+         * can be updated meanwhile. Fields never straddle words if their
+         * width divides the size of the words.
+         *
+         * Contention on hot words is reduced by accumulating the updates of
+         * each thread into a buffer, which applies them in batches with a
+         * single compare-and-swap for all the updates to the same word.
+         */
+        template<template<typename ...> class Container, size_t Width = 0,
+                 typename Word = uint64_t>
+        class atomic_packed_view
+        {
+            static_assert(is_always_lock_free<Word>(),
+                          "Atomic operations on the words must be lock-free");
+        
+        public:
+            using view_type    = packed_view<Container, Width, Word>;
+            using word_type    = typename view_type::word_type;
+            using value_type   = typename view_type::value_type;
+            using overflow_opt = typename view_type::overflow_opt;
+            
+            // A pending update: the index of a field and the number to add
+            using update_type = std::pair<size_t, value_type>;
+            
+            class buffer;
+            
+            static constexpr size_t W = bitsize<word_type>();
+            
+            explicit atomic_packed_view(view_type &view)
+                : _view(&view) { }
+            
+            view_type &view() const { return *_view; }
+            
+            size_t size() const { return _view->size(); }
+            size_t width() const { return _view->width(); }
+            
+            // Largest value of a field
+            value_type max() const { return lowbits(~value_type(0), width()); }
+            
+            // Reads a field
+            value_type load(size_t index,
+                            std::memory_order order =
+                                std::memory_order_seq_cst) const;
+            
+            /*
+             * Add n to a field, or subtract it, and return the previous value
+             * of the field. The result is handled as told by opt.
+             */
+            value_type fetch_add(size_t index, value_type n,
+                                 overflow_opt opt = view_type::cant_overflow,
+                                 std::memory_order order =
+                                     std::memory_order_seq_cst)
+            {
+                return update(index, n, false, opt, order);
+            }
+            
+            value_type fetch_sub(size_t index, value_type n,
+                                 overflow_opt opt = view_type::cant_overflow,
+                                 std::memory_order order =
+                                     std::memory_order_seq_cst)
+            {
+                return update(index, n, true, opt, order);
+            }
+            
+            /*
+             * Applies a batch of additions. The updates are sorted in place
+             * and the ones to the same field are coalesced, then all the
+             * fields contained in the same word are updated together.
+             */
+            void add(update_type *updates, size_t n,
+                     overflow_opt opt = view_type::cant_overflow,
+                     std::memory_order order = std::memory_order_seq_cst);
+        
+        private:
+            // Number of locks for the fields that straddle two words
+            static constexpr size_t lock_stripes = 64;
+            
+            // Each lock has a cache line on its own
+            struct alignas(64) spinlock
+            {
+                std::atomic<bool> locked{false};
+                
+                void lock() {
+                    while(locked.exchange(true, std::memory_order_acquire))
+                        while(locked.load(std::memory_order_relaxed))
+                            std::this_thread::yield();
+                }
+                
+                void unlock() {
+                    locked.store(false, std::memory_order_release);
+                }
+            };
+            
+            spinlock &lock_for(size_t index) const {
+                return _locks[index % lock_stripes];
+            }
+            
+            word_type &word(size_t i) const {
+                assert(i < _view->container().size());
+                return _view->container()[i];
+            }
+            
+            value_type apply(value_type v, value_type n, bool subtract,
+                             overflow_opt opt) const;
+            
+            value_type update(size_t index, value_type n, bool subtract,
+                              overflow_opt opt, std::memory_order order);
+            
+            // Replaces the bits in [begin, end) of the i-th word
+            void store_bits(size_t i, size_t begin, size_t end,
+                            word_type bits, std::memory_order order);
+            
+            void add_to_word(size_t i, update_type const*updates, size_t n,
+                             overflow_opt opt, std::memory_order order);
+        
+        private:
+            view_type *_view;
+            
+            mutable spinlock _locks[lock_stripes];
+        };
+        
+        /*
+         * Per-thread buffer of additions to the fields of an
+         * atomic_packed_view, applied when the buffer is full, when
+         * flush() is called, and on destruction.
+         */
+        template<template<typename ...> class C, size_t Wd, typename Word>
+        class atomic_packed_view<C, Wd, Word>::buffer
+        {
+        public:
+            explicit buffer(atomic_packed_view &target,
+                            size_t capacity = 4096,
+                            overflow_opt opt = view_type::cant_overflow)
+                : _target(target), _capacity(capacity), _opt(opt)
+            {
+                assert(capacity > 0);
+                _pending.reserve(capacity);
+            }
+            
+            buffer(buffer const&) = delete;
+            buffer &operator=(buffer const&) = delete;
+            
+            ~buffer() { flush(); }
+            
+            void add(size_t index, value_type n) {
+                assert(index < _target.size());
+                
+                _pending.emplace_back(index, n);
+                if(_pending.size() == _capacity)
+                    flush();
+            }
+            
+            void flush() {
+                _target.add(_pending.data(), _pending.size(), _opt);
+                _pending.clear();
+            }
+        
+        private:
+            atomic_packed_view &_target;
+            std::vector<update_type> _pending;
+            size_t _capacity;
+            overflow_opt _opt;
+        };
+        
+        template<template<typename ...> class C, size_t Wd, typename Word>
+        typename atomic_packed_view<C, Wd, Word>::value_type
+        atomic_packed_view<C, Wd, Word>::apply(value_type v, value_type n,
+                                               bool subtract,
+                                               overflow_opt opt) const
+        {
+            ensure_bitsize(n, width());
+            
+            value_type m = max();
+            
+            if(opt == view_type::saturate) {
+                if(subtract)
+                    return n > v ? 0 : v - n;
+                else
+                    return n > m - v ? m : v + n;
+            }
+            
+            assert(opt == view_type::may_overflow ||
+                   (subtract ? n <= v : n <= m - v));
+            
+            return lowbits(subtract ? v - n : v + n, width());
+        }
+        
+        template<template<typename ...> class C, size_t Wd, typename Word>
+        typename atomic_packed_view<C, Wd, Word>::value_type
+        atomic_packed_view<C, Wd, Word>::load(size_t index,
+                                              std::memory_order order) const
+        {
+            assert(index < size());
+            
+            size_t p  = index * width();
+            size_t i  = p / W;
+            size_t lo = p % W;
+            
+            if(lo + width() <= W)
+                return bitfield(atomic_load(word(i), order), lo, lo + width());
+            
+            spinlock &l = lock_for(index);
+            l.lock();
+            
+            value_type v = bitfield(atomic_load(word(i), order), lo, W) |
+                           lowbits(atomic_load(word(i + 1), order),
+                                   lo + width() - W) << (W - lo);
+            
+            l.unlock();
+            
+            return v;
+        }
+        
+        template<template<typename ...> class C, size_t Wd, typename Word>
+        void atomic_packed_view<C, Wd, Word>::store_bits(size_t i,
+                                                         size_t begin,
+                                                         size_t end,
+                                                         word_type bits,
+                                                         std::memory_order order)
+        {
+            word_type w = atomic_load(word(i), std::memory_order_relaxed);
+            word_type nw;
+            
+            do {
+                nw = w;
+                set_bitfield(nw, begin, end, bits);
+            } while(!atomic_compare_exchange(word(i), w, nw, order));
+        }
+        
+        template<template<typename ...> class C, size_t Wd, typename Word>
+        typename atomic_packed_view<C, Wd, Word>::value_type
+        atomic_packed_view<C, Wd, Word>::update(size_t index, value_type n,
+                                                bool subtract,
+                                                overflow_opt opt,
+                                                std::memory_order order)
+        {
+            assert(index < size());
+            
+            size_t p  = index * width();
+            size_t i  = p / W;
+            size_t lo = p % W;
+            size_t hi = lo + width();
+            
+            if(hi <= W) {
+                word_type w = atomic_load(word(i), std::memory_order_relaxed);
+                word_type v, nw;
+                
+                do {
+                    v = bitfield(w, lo, hi);
+                    nw = w;
+                    set_bitfield(nw, lo, hi, apply(v, n, subtract, opt));
+                } while(!atomic_compare_exchange(word(i), w, nw, order));
+                
+                return v;
+            }
+            
+            // The lock is held by anyone updating this field, so its bits
+            // don't change between the loads and the stores
+            spinlock &l = lock_for(index);
+            l.lock();
+            
+            value_type v = bitfield(atomic_load(word(i), order), lo, W) |
+                           lowbits(atomic_load(word(i + 1), order),
+                                   hi - W) << (W - lo);
+            
+            value_type r = apply(v, n, subtract, opt);
+            
+            store_bits(i, lo, W, r, order);
+            store_bits(i + 1, 0, hi - W, r >> (W - lo), order);
+            
+            l.unlock();
+            
+            return v;
+        }
+        
+        /*
+         * Updates the fields contained in the i-th word with a single
+         * compare-and-swap. The updates are sorted and have distinct indexes.
+         */
+        template<template<typename ...> class C, size_t Wd, typename Word>
+        void atomic_packed_view<C, Wd, Word>::add_to_word(size_t i,
+                                                          update_type const*updates,
+                                                          size_t n,
+                                                          overflow_opt opt,
+                                                          std::memory_order order)
+        {
+            word_type w = atomic_load(word(i), std::memory_order_relaxed);
+            word_type nw;
+            
+            do {
+                nw = w;
+                for(size_t k = 0; k < n; ++k) {
+                    size_t lo = updates[k].first * width() - i * W;
+                    size_t hi = lo + width();
+                    
+                    value_type v = bitfield(nw, lo, hi);
+                    set_bitfield(nw, lo, hi,
+                                 apply(v, updates[k].second, false, opt));
+                }
+            } while(!atomic_compare_exchange(word(i), w, nw, order));
+        }
+        
+        template<template<typename ...> class C, size_t Wd, typename Word>
+        void atomic_packed_view<C, Wd, Word>::add(update_type *updates,
+                                                  size_t n,
+                                                  overflow_opt opt,
+                                                  std::memory_order order)
+        {
+            std::sort(updates, updates + n,
+                      [](update_type const&a, update_type const&b) {
+                          return a.first < b.first;
+                      });
+            
+            // Coalesce the updates to the same field, in place. With
+            // saturation, clamping the sum is the same as clamping later.
+            size_t m = 0;
+            for(size_t k = 0; k < n; ++k) {
+                if(m != 0 && updates[m - 1].first == updates[k].first)
+                    updates[m - 1].second = apply(updates[m - 1].second,
+                                                  updates[k].second,
+                                                  false, opt);
+                else
+                    updates[m++] = updates[k];
+            }
+            
+            // Runs of fields contained in the same word
+            for(size_t k = 0; k < m;)
+            {
+                size_t p = updates[k].first * width();
+                size_t i = p / W;
+                
+                if(p % W + width() > W) {
+                    update(updates[k].first, updates[k].second,
+                           false, opt, order);
+                    ++k;
+                    continue;
+                }
+                
+                size_t e = k + 1;
+                while(e < m) {
+                    size_t q = updates[e].first * width();
+                    if(q / W != i || q % W + width() > W)
+                        break;
+                    ++e;
+                }
+                
+                add_to_word(i, updates + k, e - k, opt, order);
+                k = e;
+            }
+        }
+    
+    } // namespace internal
+    
+    // Public things
+    using internal::atomic_packed_view;
+} // namespace bv
+
+#endif
@@ -19,9 +19,25 @@
 
 #include "internal/bits.h"
 #include "packed_view.h"
+#include "trace.h"
 
 #include <memory>
 #include <ostream>
+#include <vector>
+#include <array>
+
+/*
+ * Default width of the leaves, i.e. the W parameter of the bitvector
+ * typedef, and default width of the nodes. They can be defined before
+ * including this header, e.g. by the header generated by test/autotune.
+ */
+#ifndef PACKED_BITVECTOR_LEAF_WIDTH
+#define PACKED_BITVECTOR_LEAF_WIDTH 512
+#endif
+
+#ifndef PACKED_BITVECTOR_NODE_WIDTH
+#define PACKED_BITVECTOR_NODE_WIDTH 256
+#endif
 
 namespace bv
 {
@@ -47,7 +63,7 @@ namespace bv
     template<size_t W, allocation_policy_t AllocPolicy = alloc_on_demand>
     class bitvector_t
     {
-        static_assert(W % internal::bitsize<internal::bitview_base::word_type>() == 0,
+        static_assert(W % internal::bitsize<internal::bitview_base<>::word_type>() == 0,
                       "You must choose a number of bits that is multiple "
                       "of the word size");
     public:
@@ -62,8 +78,14 @@ namespace bv
          * Constructors, copies and moves...
          */
         bitvector_t() = default;
-        bitvector_t(size_t N, size_t Wn = 256);
+        
+        // Throws std::invalid_argument if valid_node_width(N, Wn) is false
+        bitvector_t(size_t N, size_t Wn = PACKED_BITVECTOR_NODE_WIDTH);
         ~bitvector_t() = default;
+        
+        // Tells if nodes of Wn bits can hold the pointers to their children
+        // in a bitvector of capacity N. Any width is fine if N <= W.
+        static bool valid_node_width(size_t N, size_t Wn);
 
         bitvector_t(bitvector_t const&);
         bitvector_t(bitvector_t &&) = default;
@@ -111,10 +133,105 @@ namespace bv
         };
         info_t info() const;
         size_t memory() const;
-        static void test(std::ostream &stream, size_t N, size_t Wn,
-                         bool random,
-                         bool testrank, bool dumpinfo,
-                         bool dumpnode, bool dumpcontents);
+        
+        /*
+         * Instrumentation. PACKED_BITVECTOR_STATS, PACKED_BITVECTOR_HEATMAP
+         * and PACKED_BITVECTOR_TRACE add members to the tree, so each of
+         * them must be defined in all the translation units of a program or
+         * in none. Mixing them breaks the one definition rule, with trees of
+         * different layouts under the same name.
+         */
+        
+        // Statistics about the slow paths of insertions. They are collected
+        // only if PACKED_BITVECTOR_STATS is defined before including this
+        // header, otherwise they cost nothing and are all zero.
+        struct stats_t {
+            bool enabled;
+            size_t leaf_redistributions;
+            size_t node_redistributions;
+            size_t splits;            // Children added by insert_child()
+            size_t root_splits;       // Increases of the height
+            size_t bits_moved;        // By leaf redistributions
+            size_t keys_moved;        // By node redistributions
+            size_t node_allocations;
+            size_t leaf_allocations;
+            size_t buffer_bytes;      // Temporary buffers of redistributions
+        };
+        stats_t stats() const;
+        void reset_stats();
+        
+        // Shape of the tree and memory used by each of its buffers, found
+        // by walking the whole tree
+        struct report_t {
+            // Bytes of the elements in use, and bytes allocated by the
+            // container, with the unused capacity. The allocation is exact
+            // for vectors. For deques it's estimated from the block and map
+            // sizes of libstdc++ and libc++, and with other libraries it's
+            // only the bytes of the elements. 'exact' tells which is which.
+            struct buffer_t {
+                size_t used;
+                size_t allocated;
+                bool exact;
+            };
+            
+            // Nodes at each level, from the leaves (level 0) to the root
+            std::vector<size_t> level_nodes;
+            
+            // Number of internal nodes with k children, for k <= degree + 1
+            std::vector<size_t> children;
+            
+            // Number of leaves by fill factor, in buckets of 10%
+            std::array<size_t, 10> leaf_fill;
+            
+            buffer_t sizes;
+            buffer_t ranks;
+            buffer_t pointers;
+            buffer_t leaves;
+            
+            // Total bytes allocated, including the bitvector's own data,
+            // exact if the allocations of all the buffers are
+            size_t bytes;
+            bool exact;
+        };
+        report_t report() const;
+        
+        // Where the operations land in the tree, for profile-guided layout
+        // and encoding of the leaves. One operation every 'period' is
+        // sampled, only if PACKED_BITVECTOR_HEATMAP is defined before
+        // including this header, otherwise this is empty and the sampling
+        // costs nothing. Sampling writes to the bitvector even for reads,
+        // so concurrent reads aren't safe when it's enabled.
+        struct heatmap_t {
+            struct leaf_t {
+                size_t index;   // Index in the leaves array
+                size_t bits;
+                size_t reads;   // Sampled access() and rank()
+                size_t writes;  // Sampled set() and insert()
+            };
+            
+            bool enabled;
+            size_t period;
+            size_t samples;
+            
+            // Samples ending at each depth, from the root at depth 0. Ranks
+            // of the ends of subtrees stop before the leaves.
+            std::vector<size_t> depths;
+            
+            // The leaves in the order of the bits they hold
+            std::vector<leaf_t> leaves;
+            
+            // Writes the heatmap as text, one leaf per line
+            void dump(std::ostream &out) const;
+        };
+        heatmap_t heatmap() const;
+        void reset_heatmap(size_t period = 64);
+        
+        // Records the following operations to a binary trace (see trace.h),
+        // to be replayed by test/replay, or stops if out is null. They are
+        // recorded only if PACKED_BITVECTOR_TRACE is defined before
+        // including this header, otherwise this returns false.
+        bool trace(std::ostream *out);
+        
         template<size_t Z, allocation_policy_t AP>
         friend std::ostream &operator<<(std::ostream &s,
                                         bitvector_t<Z, AP> const&v);
@@ -123,7 +240,7 @@ namespace bv
         std::unique_ptr<internal::bt_impl<W, AllocPolicy>> _impl;
     };
     
-    using bitvector = bitvector_t<512, alloc_on_demand>;
+    using bitvector = bitvector_t<PACKED_BITVECTOR_LEAF_WIDTH, alloc_on_demand>;
 }
 
 #include "internal/bitvector.hpp"
@@ -18,12 +18,14 @@
 #define PACKED_BITVECTOR_BITVIEW_H
 
 #include "internal/bits.h"
+#include "internal/simd.h"
 #include "internal/view_reference.h"
 
 #include <cmath>
 #include <cstdlib>
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <cassert>
 #include <limits>
 #include <tuple>
@@ -32,16 +34,27 @@
 namespace bv
 {
     namespace internal {
+        /*
+         * The words can be of any unsigned integer type at least 32 bits
+         * wide, including uint128_t where available
+         */
+        template<typename Word = uint64_t>
         class bitview_base {
         public:
-            using word_type = uint64_t;
+            using word_type = Word;
+            
+            static_assert(is_integer<Word>::value &&
+                          !std::is_signed<Word>::value &&
+                          sizeof(Word) >= sizeof(uint32_t),
+                          "Words must be unsigned integers of at least 32 bits");
         };
         
-        template<template<typename ...> class Container>
-        class bitview : public bitview_base
+        template<template<typename ...> class Container,
+                 typename Word = uint64_t>
+        class bitview : public bitview_base<Word>
         {
         public:
-            using bitview_base::word_type;
+            using typename bitview_base<Word>::word_type;
             using value_type = bool;
 
             static constexpr size_t W = bitsize<word_type>();
@@ -60,6 +73,11 @@ namespace bv
             bitview(size_t size)
                 : _container(required_container_size(size)) { }
             
+            // Wraps an existing container, e.g. a buffer_view over external
+            // memory. The view covers all of its words.
+            explicit bitview(container_type container)
+                : _container(std::move(container)) { }
+            
             bitview(bitview const&) = default;
             bitview(bitview &&) = default;
             bitview &operator=(bitview const&) = default;
@@ -68,6 +86,18 @@ namespace bv
             container_type const&container() const { return _container; }
             container_type      &container()       { return _container; }
             
+            // Pointer to the words of the container if they're stored
+            // contiguously (e.g. std::vector), nullptr otherwise
+            word_type const*data() const {
+                return contiguous_data(_container,
+                                       is_contiguous<container_type const>());
+            }
+            
+            word_type *data() {
+                return contiguous_data(_container,
+                                       is_contiguous<container_type>());
+            }
+            
             // Number of bits handled by the view
             size_t size() const { return _container.size() * W; }
             
@@ -107,10 +137,59 @@ namespace bv
                       size_t dest_begin, size_t dest_end);
             
             template<template<typename ...> class C>
-            void copy(bitview<C> const&src,
+            void copy(bitview<C, Word> const&src,
                       size_t src_begin, size_t src_end,
                       size_t dest_begin, size_t dest_end);
             
+            /*
+             * Bitwise operations between the bits in [dest_begin, dest_end)
+             * and the bits of a range of src. As in copy(), the shorter of
+             * the two ranges is used, and they must not overlap unless they
+             * are the same range.
+             * popcount_and() counts the bits set in both ranges.
+             */
+            template<template<typename ...> class C>
+            void and_with(bitview<C, Word> const&src,
+                          size_t src_begin, size_t src_end,
+                          size_t dest_begin, size_t dest_end);
+            
+            template<template<typename ...> class C>
+            void or_with(bitview<C, Word> const&src,
+                         size_t src_begin, size_t src_end,
+                         size_t dest_begin, size_t dest_end);
+            
+            template<template<typename ...> class C>
+            void xor_with(bitview<C, Word> const&src,
+                          size_t src_begin, size_t src_end,
+                          size_t dest_begin, size_t dest_end);
+            
+            template<template<typename ...> class C>
+            void andnot_with(bitview<C, Word> const&src,
+                             size_t src_begin, size_t src_end,
+                             size_t dest_begin, size_t dest_end);
+            
+            template<template<typename ...> class C>
+            size_t popcount_and(bitview<C, Word> const&src,
+                                size_t src_begin, size_t src_end,
+                                size_t begin, size_t end) const;
+            
+            // Inverts the bits in the range [begin, end)
+            void flip(size_t begin, size_t end);
+            
+            /*
+             * Batched get() and set() of n ranges of len bits, beginning at
+             * the positions in begins, e.g. to extract many short keys at
+             * random offsets. The words of upcoming ranges are prefetched,
+             * so the cache misses of different ranges overlap, and with AVX2
+             * four ranges are extracted at once. Ranges are scattered in
+             * order, so if they overlap the last one wins.
+             */
+            void gather(size_t const*begins, size_t len,
+                        word_type *out, size_t n) const;
+            
+            void scatter(size_t const*begins, size_t len,
+                         word_type const*in, size_t n);
+            
             std::string to_binary(size_t begin, size_t end,
                                   size_t sep, char ssep) const;
             
@@ -150,39 +229,134 @@ namespace bv
             range_location_t locate(size_t begin, size_t end) const;
             
             template<template<typename ...> class C>
-            void copy_forward(bitview<C> const&src,
+            void copy_forward(bitview<C, Word> const&src,
                               size_t src_begin, size_t src_end,
                               size_t dest_begin, size_t dest_end);
             
             template<template<typename ...> class C>
-            void copy_backward(bitview<C> const&src,
+            void copy_backward(bitview<C, Word> const&src,
                                size_t src_begin, size_t src_end,
                                size_t dest_begin, size_t dest_end);
+            
+            template<template<typename ...> class C>
+            void copy_words(bitview<C, Word> const&src, size_t src_pos,
+                            size_t index, size_t n, bool backward);
+            
+            template<template<typename ...> class C, typename Op>
+            void combine(bitview<C, Word> const&src,
+                         size_t src_begin, size_t src_end,
+                         size_t dest_begin, size_t dest_end, Op op);
         private:
             container_type _container;
         };
         
-        template<size_t Bits>
+        template<size_t Bits, typename Word = uint64_t>
         struct bitarray_t {
             template<typename T>
-            using array = std::array<T, Bits / bitsize<bitview_base::word_type>()>;
+            using array = std::array<T, Bits / bitsize<Word>()>;
         };
         
-        template<size_t Bits>
-        using bitarray = bitview<bitarray_t<Bits>:: template array>;
+        template<size_t Bits, typename Word = uint64_t>
+        using bitarray = bitview<bitarray_t<Bits, Word>:: template array, Word>;
         
-        template<template<typename ...> class C>
-        std::string to_binary(bitview<C> const&v,
+        template<template<typename ...> class C, typename Word>
+        std::string to_binary(bitview<C, Word> const&v,
                               size_t sep = 8, char ssep = ' ') {
             return v.to_binary(0, v.size(), sep, ssep);
         }
         
+        /*
+         * Sequential reader and writer of chunks of bits at consecutive
+         * positions of a container of words. Reading or writing a chunk
+         * takes a few shifts, with no need to locate it from scratch as
+         * get() and set() do, so they are the building blocks of the bulk
+         * operations. Chunks must be narrower than a word.
+         */
+        template<typename Container>
+        class bit_reader
+        {
+        public:
+            using word_type = typename Container::value_type;
+            static constexpr size_t W = bitsize<word_type>();
+            
+            bit_reader(Container const&words, size_t begin)
+                : _words(words), _index(begin / W),
+                  _avail(W - begin % W),
+                  _cur(words[_index] >> (begin % W)) { }
+            
+            word_type read(size_t width)
+            {
+                assert(width < W);
+                
+                if(_avail >= width) {
+                    word_type value = lowbits(_cur, width);
+                    _cur >>= width;
+                    _avail -= width;
+                    
+                    return value;
+                }
+                
+                word_type next = _words[++_index];
+                word_type value = lowbits(_cur | (next << _avail), width);
+                
+                _cur = next >> (width - _avail);
+                _avail += W - width;
+                
+                return value;
+            }
+        
+        private:
+            Container const&_words;
+            size_t _index;
+            size_t _avail;
+            word_type _cur;
+        };
+        
+        template<typename Container>
+        class bit_writer
+        {
+        public:
+            using word_type = typename Container::value_type;
+            static constexpr size_t W = bitsize<word_type>();
+            
+            bit_writer(Container &words, size_t begin)
+                : _words(words), _index(begin / W), _fill(begin % W),
+                  _cur(lowbits(words[_index], begin % W)) { }
+            
+            void write(word_type value, size_t width)
+            {
+                assert(width < W);
+                ensure_bitsize(value, width);
+                
+                _cur |= value << _fill;
+                _fill += width;
+                
+                if(_fill >= W) {
+                    _words[_index++] = _cur;
+                    _fill -= W;
+                    _cur = _fill == 0 ? 0 : value >> (width - _fill);
+                }
+            }
+            
+            // Writes the last partial word, preserving the bits that follow
+            void flush() {
+                if(_fill != 0)
+                    _words[_index] = _cur | highbits(_words[_index], W - _fill);
+            }
+        
+        private:
+            Container &_words;
+            size_t _index;
+            size_t _fill;
+            word_type _cur;
+        };
+        
         /*
          * Class implementation
          */
-        template<template<typename ...> class C>
-        typename bitview<C>::range_location_t
-        bitview<C>::locate(size_t begin, size_t end) const
+        template<template<typename ...> class C, typename Word>
+        typename bitview<C, Word>::range_location_t
+        bitview<C, Word>::locate(size_t begin, size_t end) const
         {
             size_t index  = begin / W;
             size_t lbegin = begin % W;
@@ -203,9 +377,9 @@ namespace bv
          *
          * Original comments left.
          */
-        template < template<typename ...> class C >
-        bitview_base::word_type
-        bitview<C>::get(size_t begin, size_t end) const
+        template < template<typename ...> class C, typename Word >
+        typename bitview<C, Word>::word_type
+        bitview<C, Word>::get(size_t begin, size_t end) const
         {
             static constexpr size_t bits = bitsize<word_type>();
             static constexpr size_t mask = ~ size_t(0) / bits * bits;
@@ -235,15 +409,16 @@ namespace bv
             
         }
         
-        template<template<typename ...> class Container>
-        bool bitview<Container>::get(size_t index) const {
+        template<template<typename ...> class Container, typename Word>
+        bool bitview<Container, Word>::get(size_t index) const {
             assert(index < size());
             
             return (_container[index / W] & (word_type(1) << (index % W))) != 0;
         }
         
-        template<template<typename ...> class Container>
-        size_t bitview<Container>::popcount(size_t begin, size_t end) const
+        template<template<typename ...> class Container, typename Word>
+        size_t
+        bitview<Container, Word>::popcount(size_t begin, size_t end) const
         {
             if(is_empty_range(begin, end))
                 return 0;
@@ -266,13 +441,14 @@ namespace bv
             return result;
         }
         
-        template<template<typename ...> class Container>
-        size_t bitview<Container>::popcount() const {
+        template<template<typename ...> class Container, typename Word>
+        size_t bitview<Container, Word>::popcount() const {
             return popcount(0, size());
         }
         
-        template<template<typename ...> class Container>
-        void bitview<Container>::set(size_t begin, size_t end, word_type value)
+        template<template<typename ...> class Container, typename Word>
+        void
+        bitview<Container, Word>::set(size_t begin, size_t end, word_type value)
         {
             if(is_empty_range(begin, end))
                 return;
@@ -294,8 +470,8 @@ namespace bv
             }
         }
         
-        template<template<typename ...> class Container>
-        void bitview<Container>::set(size_t index, bool bit)
+        template<template<typename ...> class Container, typename Word>
+        void bitview<Container, Word>::set(size_t index, bool bit)
         {
             const word_type mask    = ~(word_type(1) << (index % W));
             const word_type bitmask = word_type(bit) << (index % W);
@@ -303,21 +479,25 @@ namespace bv
             _container[index / W] = (_container[index / W] & mask) | bitmask;
         }
         
-        template<template<typename ...> class Container>
-        void bitview<Container>::clear()
+        template<template<typename ...> class Container, typename Word>
+        void bitview<Container, Word>::clear()
         {
             std::fill(_container.begin(), _container.end(), 0);
         }
         
-        template<template<typename ...> class Container>
+        template<template<typename ...> class Container, typename Word>
         template<template<typename ...> class C>
-        void bitview<Container>::copy_forward(bitview<C> const&srcbv,
-                                              size_t src_begin, 
-                                              size_t src_end,
-                                              size_t dest_begin, 
-                                              size_t dest_end)
+        void
+        bitview<Container, Word>::copy_forward(bitview<C, Word> const&srcbv,
+                                               size_t src_begin,
+                                               size_t src_end,
+                                               size_t dest_begin,
+                                               size_t dest_end)
         {
             assert(src_end - src_begin == dest_end - dest_begin);
+            
+            if(is_empty_range(src_begin, src_end))
+                return;
 
             size_t dest_begin_index = dest_begin / W;
             size_t dest_begin_pos   = dest_begin % W;
@@ -336,12 +516,11 @@ namespace bv
             _container[dest_begin_index] = v;
 
             size_t src_pos = src_begin + len;
-            for(size_t i = dest_begin_index + 1; 
-                i < dest_end_index; 
-                ++i, src_pos += W) 
-            {
-                _container[i] = srcbv.get(src_pos, src_pos + W);
-            }
+            size_t words = dest_end_index > dest_begin_index ?
+                           dest_end_index - dest_begin_index - 1 : 0;
+            
+            copy_words(srcbv, src_pos, dest_begin_index + 1, words, false);
+            src_pos += words * W;
 
             len = src_end - src_pos;
             if(len > 0) {
@@ -351,15 +530,19 @@ namespace bv
             }
         }
         
-        template<template<typename ...> class Container>
+        template<template<typename ...> class Container, typename Word>
         template<template<typename ...> class C>
-        void bitview<Container>::copy_backward(bitview<C> const&srcbv,
-                                               size_t src_begin, 
-                                               size_t src_end,
-                                               size_t dest_begin,
-                                               size_t dest_end)
+        void
+        bitview<Container, Word>::copy_backward(bitview<C, Word> const&srcbv,
+                                                size_t src_begin,
+                                                size_t src_end,
+                                                size_t dest_begin,
+                                                size_t dest_end)
         {
             assert(src_end - src_begin == dest_end - dest_begin);
+            
+            if(is_empty_range(src_begin, src_end))
+                return;
 
             size_t dest_begin_index = dest_begin / W;
             size_t dest_begin_pos   = dest_begin % W;
@@ -372,19 +555,20 @@ namespace bv
             size_t lastpart = dest_end_pos - lowpart;
 
             size_t src_pos = src_end - lastpart;
-            _container[dest_end_index] =
-                highbits(_container[dest_end_index], W - dest_end_pos) |
-                (srcbv.get(src_pos, src_end) << lowpart)               |
-                lowbits(_container[dest_end_index], lowpart);
+            if(dest_end_pos != 0) {
+                _container[dest_end_index] =
+                    highbits(_container[dest_end_index], W - dest_end_pos) |
+                    (srcbv.get(src_pos, src_end) << lowpart)               |
+                    lowbits(_container[dest_end_index], lowpart);
+            }
 
             size_t dest_pos = dest_end - lastpart;
-
-            while(dest_pos - dest_begin >= W) {
-                dest_pos -= W;
-                src_pos  -= W;
-
-                _container[dest_pos / W] = srcbv.get(src_pos, src_pos + W);
-            }
+            size_t words = (dest_pos - dest_begin) / W;
+            
+            dest_pos -= words * W;
+            src_pos  -= words * W;
+            
+            copy_words(srcbv, src_pos, dest_pos / W, words, true);
 
             size_t firstpart = src_pos - src_begin;
             if(firstpart > 0) {
@@ -394,11 +578,62 @@ namespace bv
             }
         }
         
-        template<template<typename ...> class Container>
+        /*
+         * Copies n whole words starting from bit src_pos of src into the
+         * words starting from index. If src_pos is aligned to a word it's a
+         * plain move, otherwise each word is a funnel shift of two source
+         * words, vectorized if both containers are contiguous.
+         * If the two views are the same, the words are copied backward
+         * when the destination comes after the source.
+         */
+        template<template<typename ...> class Container, typename Word>
         template<template<typename ...> class C>
-        void bitview<Container>::copy(bitview<C> const&src,
-                                      size_t src_begin, size_t src_end,
-                                      size_t dest_begin, size_t dest_end)
+        void bitview<Container, Word>::copy_words(bitview<C, Word> const&srcbv,
+                                                  size_t src_pos,
+                                                  size_t index, size_t n,
+                                                  bool backward)
+        {
+            if(n == 0)
+                return;
+            
+            size_t first = src_pos / W;
+            size_t shift = src_pos % W;
+            
+            word_type *dest = data();
+            word_type const*src = srcbv.data();
+            
+            if(dest != nullptr && src != nullptr) {
+                if(shift == 0)
+                    std::memmove(dest + index, src + first,
+                                 n * sizeof(word_type));
+                else if(backward)
+                    funnel_words_backward(dest + index, src + first, n, shift);
+                else
+                    funnel_words(dest + index, src + first, n, shift);
+                
+                return;
+            }
+            
+            auto to   = _container.begin() + index;
+            auto from = srcbv.container().begin() + first;
+            
+            if(shift == 0 && backward)
+                for(size_t i = n; i-- > 0;)
+                    to[i] = from[i];
+            else if(shift == 0)
+                for(size_t i = 0; i < n; ++i)
+                    to[i] = from[i];
+            else if(backward)
+                funnel_words_backward(to, from, n, shift);
+            else
+                funnel_words(to, from, n, shift);
+        }
+        
+        template<template<typename ...> class Container, typename Word>
+        template<template<typename ...> class C>
+        void bitview<Container, Word>::copy(bitview<C, Word> const&src,
+                                            size_t src_begin, size_t src_end,
+                                            size_t dest_begin, size_t dest_end)
         {
             size_t srclen = src_end - src_begin;
             size_t destlen = dest_end - dest_begin;
@@ -412,10 +647,10 @@ namespace bv
                          dest_begin, dest_begin + srclen);
         }
         
-        template<template<typename ...> class Container>
-        void bitview<Container>::copy(bitview const&src,
-                                      size_t src_begin, size_t src_end,
-                                      size_t dest_begin, size_t dest_end)
+        template<template<typename ...> class Container, typename Word>
+        void bitview<Container, Word>::copy(bitview const&src,
+                                            size_t src_begin, size_t src_end,
+                                            size_t dest_begin, size_t dest_end)
         {
             size_t srclen = src_end - src_begin;
             size_t destlen = dest_end - dest_begin;
@@ -433,9 +668,249 @@ namespace bv
                              dest_begin, dest_begin + srclen);
         }
         
-        template<template<typename ...> class Container>
-        void bitview<Container>::insert(size_t begin, size_t end,
-                                        word_type value)
+        /*
+         * The bits before the first word boundary of the destination and
+         * the ones after the last are combined with get() and set(), while
+         * the whole words in between go through combine_words()
+         */
+        template<template<typename ...> class Container, typename Word>
+        template<template<typename ...> class C, typename Op>
+        void
+        bitview<Container, Word>::combine(bitview<C, Word> const&srcbv,
+                                          size_t src_begin, size_t src_end,
+                                          size_t dest_begin, size_t dest_end,
+                                          Op op)
+        {
+            if(is_empty_range(src_begin, src_end) ||
+               is_empty_range(dest_begin, dest_end))
+                return;
+            
+            size_t len = std::min(src_end - src_begin, dest_end - dest_begin);
+            
+            check_valid_range(src_begin, src_begin + len, srcbv.size());
+            check_valid_range(dest_begin, dest_begin + len, size());
+            
+            size_t head = std::min(len, (W - dest_begin % W) % W);
+            if(head != 0) {
+                word_type v = op(get(dest_begin, dest_begin + head),
+                                 srcbv.get(src_begin, src_begin + head));
+                set(dest_begin, dest_begin + head, lowbits(v, head));
+            }
+            
+            size_t index = (dest_begin + head) / W;
+            size_t src_pos = src_begin + head;
+            size_t words = (len - head) / W;
+            
+            if(words != 0) {
+                word_type *dest = data();
+                word_type const*src = srcbv.data();
+                
+                if(dest != nullptr && src != nullptr)
+                    combine_words(dest + index, src + src_pos / W,
+                                  words, src_pos % W, op);
+                else
+                    combine_words(_container.begin() + index,
+                                  srcbv.container().begin() + src_pos / W,
+                                  words, src_pos % W, op);
+            }
+            
+            size_t done = head + words * W;
+            if(done < len) {
+                word_type v = op(get(dest_begin + done, dest_begin + len),
+                                 srcbv.get(src_begin + done, src_begin + len));
+                set(dest_begin + done, dest_begin + len,
+                    lowbits(v, len - done));
+            }
+        }
+        
+        template<template<typename ...> class Container, typename Word>
+        template<template<typename ...> class C>
+        void
+        bitview<Container, Word>::and_with(bitview<C, Word> const&src,
+                                           size_t src_begin, size_t src_end,
+                                           size_t dest_begin, size_t dest_end)
+        {
+            combine(src, src_begin, src_end, dest_begin, dest_end, and_op());
+        }
+        
+        template<template<typename ...> class Container, typename Word>
+        template<template<typename ...> class C>
+        void
+        bitview<Container, Word>::or_with(bitview<C, Word> const&src,
+                                          size_t src_begin, size_t src_end,
+                                          size_t dest_begin, size_t dest_end)
+        {
+            combine(src, src_begin, src_end, dest_begin, dest_end, or_op());
+        }
+        
+        template<template<typename ...> class Container, typename Word>
+        template<template<typename ...> class C>
+        void
+        bitview<Container, Word>::xor_with(bitview<C, Word> const&src,
+                                           size_t src_begin, size_t src_end,
+                                           size_t dest_begin, size_t dest_end)
+        {
+            combine(src, src_begin, src_end, dest_begin, dest_end, xor_op());
+        }
+        
+        template<template<typename ...> class Container, typename Word>
+        template<template<typename ...> class C>
+        void
+        bitview<Container, Word>::andnot_with(bitview<C, Word> const&src,
+                                              size_t src_begin, size_t src_end,
+                                              size_t dest_begin, size_t dest_end)
+        {
+            combine(src, src_begin, src_end, dest_begin, dest_end, andnot_op());
+        }
+        
+        template<template<typename ...> class Container, typename Word>
+        template<template<typename ...> class C>
+        size_t
+        bitview<Container, Word>::popcount_and(bitview<C, Word> const&srcbv,
+                                               size_t src_begin, size_t src_end,
+                                               size_t begin, size_t end) const
+        {
+            if(is_empty_range(src_begin, src_end) || is_empty_range(begin, end))
+                return 0;
+            
+            size_t len = std::min(src_end - src_begin, end - begin);
+            
+            check_valid_range(src_begin, src_begin + len, srcbv.size());
+            check_valid_range(begin, begin + len, size());
+            
+            size_t head = std::min(len, (W - begin % W) % W);
+            size_t result = ::bv::internal::popcount(
+                                get(begin, begin + head) &
+                                srcbv.get(src_begin, src_begin + head));
+            
+            size_t index = (begin + head) / W;
+            size_t src_pos = src_begin + head;
+            size_t words = (len - head) / W;
+            
+            if(words != 0) {
+                word_type const*data = this->data();
+                word_type const*src = srcbv.data();
+                
+                if(data != nullptr && src != nullptr)
+                    result += popcount_and_words(data + index,
+                                                 src + src_pos / W,
+                                                 words, src_pos % W);
+                else
+                    result += popcount_and_words(
+                                  _container.begin() + index,
+                                  srcbv.container().begin() + src_pos / W,
+                                  words, src_pos % W);
+            }
+            
+            size_t done = head + words * W;
+            
+            return result + ::bv::internal::popcount(
+                                get(begin + done, begin + len) &
+                                srcbv.get(src_begin + done, src_begin + len));
+        }
+        
+        template<template<typename ...> class Container, typename Word>
+        void bitview<Container, Word>::flip(size_t begin, size_t end)
+        {
+            if(is_empty_range(begin, end))
+                return;
+            
+            check_valid_range(begin, end, size());
+            
+            size_t head = std::min(end - begin, (W - begin % W) % W);
+            if(head != 0)
+                set(begin, begin + head,
+                    lowbits(~get(begin, begin + head), head));
+            
+            size_t p = begin + head;
+            for(; end - p >= W; p += W)
+                _container[p / W] = ~_container[p / W];
+            
+            if(p < end)
+                set(p, end, lowbits(~get(p, end), end - p));
+        }
+        
+        template<template<typename ...> class Container, typename Word>
+        void bitview<Container, Word>::gather(size_t const*begins, size_t len,
+                                              word_type *out, size_t n) const
+        {
+            assert(len <= W);
+            
+            if(len == 0) {
+                std::fill(out, out + n, word_type(0));
+                return;
+            }
+            
+            word_type const*words = data();
+            
+            if(words == nullptr) {
+                for(size_t i = 0; i < n; ++i)
+                    out[i] = get(begins[i], begins[i] + len);
+                return;
+            }
+            
+            size_t i = gather_ranges(words, _container.size(),
+                                     begins, len, out, n);
+            
+            for(; i < n; ++i)
+            {
+                if(i + prefetch_distance < n)
+                    __builtin_prefetch(words + begins[i + prefetch_distance] / W);
+                
+                size_t b = begins[i];
+                check_valid_range(b, b + len, size());
+                
+                size_t index = b / W;
+                size_t shift = b % W;
+                
+                word_type v = words[index] >> shift;
+                if(shift + len > W)
+                    v |= words[index + 1] << (W - shift);
+                
+                out[i] = lowbits(v, len);
+            }
+        }
+        
+        template<template<typename ...> class Container, typename Word>
+        void bitview<Container, Word>::scatter(size_t const*begins, size_t len,
+                                               word_type const*in, size_t n)
+        {
+            assert(len <= W);
+            
+            if(len == 0)
+                return;
+            
+            word_type *words = data();
+            
+            if(words == nullptr) {
+                for(size_t i = 0; i < n; ++i)
+                    set(begins[i], begins[i] + len, in[i]);
+                return;
+            }
+            
+            for(size_t i = 0; i < n; ++i)
+            {
+                if(i + prefetch_distance < n)
+                    __builtin_prefetch(words + begins[i + prefetch_distance] / W,
+                                       1);
+                
+                size_t b = begins[i];
+                check_valid_range(b, b + len, size());
+                
+                size_t index = b / W;
+                size_t shift = b % W;
+                
+                set_bitfield(words[index], shift,
+                             std::min(size_t(W), shift + len), in[i]);
+                if(shift + len > W)
+                    set_bitfield(words[index + 1], 0, shift + len - W,
+                                 word_type(in[i] >> (W - shift)));
+            }
+        }
+        
+        template<template<typename ...> class Container, typename Word>
+        void bitview<Container, Word>::insert(size_t begin, size_t end,
+                                              word_type value)
         {
             if(is_empty_range(begin, end))
                 return;
@@ -446,8 +921,8 @@ namespace bv
             set(begin, end, value);
         }
         
-        template<template<typename ...> class Container>
-        void bitview<Container>::insert(size_t index, bool bit)
+        template<template<typename ...> class Container, typename Word>
+        void bitview<Container, Word>::insert(size_t index, bool bit)
         {
             size_t i = index / W;
             size_t pos = index % W;
@@ -470,9 +945,10 @@ namespace bv
             }
         }
         
-        template<template<typename ...> class Container>
-        std::string bitview<Container>::to_binary(size_t begin, size_t end,
-                                                  size_t sep, char ssep) const
+        template<template<typename ...> class Container, typename Word>
+        std::string
+        bitview<Container, Word>::to_binary(size_t begin, size_t end,
+                                            size_t sep, char ssep) const
         {
             std::string s;
             
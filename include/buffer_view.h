@@ -0,0 +1,127 @@
+/*
+ * Copyright 2014 Nicola Gigante
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PACKED_BITVECTOR_BUFFER_VIEW_H
+#define PACKED_BITVECTOR_BUFFER_VIEW_H
+
+#include "internal/bits.h"
+
+#include <cstddef>
+#include <cassert>
+#include <iterator>
+#include <type_traits>
+
+namespace bv
+{
+    namespace internal {
+        
+        /*
+         * Non-owning container over an external buffer of words, given as
+         * a pointer and a number of elements. It can be used as the
+         * Container of a bitview or a packed_view to work in place on
+         * memory owned by someone else, e.g. a network buffer or a mapped
+         * file, which must outlive the view.
+         * Copying a buffer_view copies the pointer, not the words, and the
+         * size is fixed, so resize() is not available.
+         * If T is const-qualified the words can only be read: use
+         * const_buffer_view<T> as the Container in this case.
+         */
+        template<typename T>
+        class buffer_view
+        {
+        public:
+            using value_type             = typename std::remove_const<T>::type;
+            using size_type              = size_t;
+            using difference_type        = std::ptrdiff_t;
+            using pointer                = T *;
+            using const_pointer          = value_type const*;
+            using reference              = T &;
+            using const_reference        = value_type const&;
+            using iterator               = pointer;
+            using const_iterator         = const_pointer;
+            using reverse_iterator       = std::reverse_iterator<iterator>;
+            using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+            
+            buffer_view() = default;
+            
+            buffer_view(pointer data, size_t size)
+                : _data(data), _size(size)
+            {
+                assert(data != nullptr || size == 0);
+            }
+            
+            buffer_view(buffer_view const&) = default;
+            buffer_view &operator=(buffer_view const&) = default;
+            
+            // A view over mutable words can be seen as a read-only one
+            template<typename U,
+                     REQUIRES(std::is_same<T, U const>::value &&
+                              !std::is_same<T, U>::value)>
+            buffer_view(buffer_view<U> const&other)
+                : _data(other.data()), _size(other.size()) { }
+            
+            pointer       data()       { return _data; }
+            const_pointer data() const { return _data; }
+            
+            size_t size() const { return _size; }
+            bool empty() const { return _size == 0; }
+            
+            reference operator[](size_t i) {
+                assert(i < _size);
+                return _data[i];
+            }
+            
+            const_reference operator[](size_t i) const {
+                assert(i < _size);
+                return _data[i];
+            }
+            
+            iterator       begin()       { return _data; }
+            const_iterator begin() const { return _data; }
+            iterator       end()         { return _data + _size; }
+            const_iterator end()   const { return _data + _size; }
+            
+            const_iterator cbegin() const { return begin(); }
+            const_iterator cend()   const { return end(); }
+            
+            reverse_iterator rbegin() { return reverse_iterator(end()); }
+            reverse_iterator rend()   { return reverse_iterator(begin()); }
+            
+            const_reverse_iterator rbegin() const {
+                return const_reverse_iterator(end());
+            }
+            
+            const_reverse_iterator rend() const {
+                return const_reverse_iterator(begin());
+            }
+        
+        private:
+            pointer _data = nullptr;
+            size_t _size = 0;
+        };
+        
+        // Read-only buffer, to use as Container of a view that is only read
+        template<typename T>
+        using const_buffer_view = buffer_view<T const>;
+    
+    } // namespace internal
+    
+    // Public things
+    using internal::buffer_view;
+    using internal::const_buffer_view;
+} // namespace bv
+
+#endif
@@ -0,0 +1,95 @@
+/*
+ * Copyright 2014 Nicola Gigante
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PACKED_BITVECTOR_ATOMIC_H
+#define PACKED_BITVECTOR_ATOMIC_H
+
+#include "bits.h"
+
+#include <atomic>
+
+/*
+ * Atomic operations on plain words, i.e. words that are not std::atomic
+ * objects, like the ones stored in the containers of the views.
+ * They're thin wrappers around the __atomic builtins of GCC and Clang,
+ * which do what std::atomic_ref does in C++20.
+ */
+namespace bv
+{
+    namespace internal {
+        
+        // Tells if atomic operations on T are lock-free on every address
+        // aligned to the size of T
+        template<typename T>
+        constexpr bool is_always_lock_free() {
+            return __atomic_always_lock_free(sizeof(T), 0);
+        }
+        
+        // Translates a std::memory_order into the builtins' constants
+        constexpr int builtin_order(std::memory_order order) {
+            return order == std::memory_order_relaxed ? __ATOMIC_RELAXED
+                 : order == std::memory_order_consume ? __ATOMIC_CONSUME
+                 : order == std::memory_order_acquire ? __ATOMIC_ACQUIRE
+                 : order == std::memory_order_release ? __ATOMIC_RELEASE
+                 : order == std::memory_order_acq_rel ? __ATOMIC_ACQ_REL
+                 : __ATOMIC_SEQ_CST;
+        }
+        
+        // Loads can't have release semantics, so they are dropped
+        constexpr int builtin_load_order(std::memory_order order) {
+            return order == std::memory_order_release ? __ATOMIC_RELAXED
+                 : order == std::memory_order_acq_rel ? __ATOMIC_ACQUIRE
+                 : builtin_order(order);
+        }
+        
+        template<typename T>
+        T atomic_load(T const&word, std::memory_order order) {
+            return __atomic_load_n(&word, builtin_load_order(order));
+        }
+        
+        template<typename T>
+        T atomic_fetch_or(T &word, T value, std::memory_order order) {
+            return __atomic_fetch_or(&word, value, builtin_order(order));
+        }
+        
+        template<typename T>
+        T atomic_fetch_and(T &word, T value, std::memory_order order) {
+            return __atomic_fetch_and(&word, value, builtin_order(order));
+        }
+        
+        template<typename T>
+        T atomic_fetch_add(T &word, T value, std::memory_order order) {
+            return __atomic_fetch_add(&word, value, builtin_order(order));
+        }
+        
+        /*
+         * Replaces word with desired if it's equal to expected, otherwise
+         * stores the current value into expected. It can fail spuriously,
+         * so it's meant to be used in a loop.
+         */
+        template<typename T>
+        bool atomic_compare_exchange(T &word, T &expected, T desired,
+                                     std::memory_order order)
+        {
+            return __atomic_compare_exchange_n(&word, &expected, desired,
+                                               true, builtin_order(order),
+                                               builtin_load_order(order));
+        }
+    
+    } // namespace internal
+} // namespace bv
+
+#endif
@@ -50,6 +50,59 @@ namespace bv
         template<bool C, typename T>
         using add_const_if_t = typename add_const_if<C, T>::type;
         
+        // Utility trait alias for the detection idiom.
+        // Would be standard if we used C++17
+        template<typename ...>
+        struct make_void {
+            using type = void;
+        };
+        
+        template<typename ...Ts>
+        using void_t = typename make_void<Ts...>::type;
+        
+        // Utility trait to detect containers that store their elements
+        // contiguously, i.e. with a data() member function
+        template<typename C, typename = void>
+        struct is_contiguous : std::false_type { };
+        
+        template<typename C>
+        struct is_contiguous<C, void_t<decltype(std::declval<C&>().data())>>
+            : std::true_type { };
+        
+        // Pointer to the elements of a contiguous container, or nullptr
+        template<typename C>
+        auto contiguous_data(C &c, std::true_type) -> decltype(c.data()) {
+            return c.data();
+        }
+        
+        template<typename C>
+        std::nullptr_t contiguous_data(C &, std::false_type) {
+            return nullptr;
+        }
+        
+        // 128 bits unsigned integers, where supported by the compiler
+#if defined(__SIZEOF_INT128__)
+        __extension__ typedef unsigned __int128 uint128_t;
+#endif
+
+        // Utility trait to detect integer types. Differently from
+        // std::is_integral, it recognizes uint128_t in strict ISO mode too
+        template<typename T>
+        struct is_integer : std::is_integral<T> { };
+
+#if defined(__SIZEOF_INT128__)
+        template<>
+        struct is_integer<uint128_t> : std::true_type { };
+#endif
+
+        // Chooses the builtins used on a word, by size: 0 for the words
+        // that fit into an unsigned int, 1 for the ones that fit into an
+        // unsigned long long, 2 for the wider ones, split into two halves
+        template<typename T>
+        using builtin_tag = std::integral_constant<int,
+            sizeof(T) <= sizeof(unsigned) ? 0 :
+            sizeof(T) <= sizeof(unsigned long long) ? 1 : 2>;
+        
         template<typename ...Args>
         void unused(Args&& ...) { }
         
@@ -76,7 +129,7 @@ namespace bv
         }
         
         // Returns the bit size of the given type
-        template<typename T, REQUIRES(std::is_integral<T>::value)>
+        template<typename T, REQUIRES(is_integer<T>::value)>
         constexpr size_t bitsize() {
             return sizeof(T) * CHAR_BIT;
         }
@@ -84,13 +137,60 @@ namespace bv
         /*
          * Count the number of set bits in a word
          */
-        template<typename T, REQUIRES(std::is_integral<T>::value)>
-        constexpr size_t popcount(T value)
+        template<typename T>
+        constexpr size_t popcount(T value, std::integral_constant<int, 0>) {
+            return size_t(__builtin_popcount(static_cast<unsigned>(value)));
+        }
+        
+        template<typename T>
+        constexpr size_t popcount(T value, std::integral_constant<int, 1>) {
+            return size_t(__builtin_popcountll(
+                              static_cast<unsigned long long>(value)));
+        }
+        
+        template<typename T>
+        constexpr size_t popcount(T value, std::integral_constant<int, 2>) {
+            return popcount(static_cast<unsigned long long>(value),
+                            builtin_tag<unsigned long long>()) +
+                   popcount(static_cast<unsigned long long>(value >> 64),
+                            builtin_tag<unsigned long long>());
+        }
+        
+        template<typename T, REQUIRES(is_integer<T>::value)>
+        constexpr size_t popcount(T value) {
+            return popcount(value, builtin_tag<T>());
+        }
+        
+        /*
+         * Count the number of trailing zeroes in a non-zero word
+         */
+        template<typename T>
+        size_t trailing_zeros(T value, std::integral_constant<int, 0>) {
+            return size_t(__builtin_ctz(static_cast<unsigned>(value)));
+        }
+        
+        template<typename T>
+        size_t trailing_zeros(T value, std::integral_constant<int, 1>) {
+            return size_t(__builtin_ctzll(
+                              static_cast<unsigned long long>(value)));
+        }
+        
+        template<typename T>
+        size_t trailing_zeros(T value, std::integral_constant<int, 2>)
+        {
+            auto low = static_cast<unsigned long long>(value);
+            
+            return low != 0 ?
+                   size_t(__builtin_ctzll(low)) :
+                   64 + size_t(__builtin_ctzll(
+                                   static_cast<unsigned long long>(value >> 64)));
+        }
+        
+        template<typename T, REQUIRES(is_integer<T>::value)>
+        size_t trailing_zeros(T value)
         {
-            static_assert(std::is_same<T, uint64_t>::value,
-                          "Popcount is implemented only for uint64_t");
-            // TODO: Check the availability of __builtin_popcountll
-            return size_t(__builtin_popcountll(value));
+            assert(value != 0);
+            return trailing_zeros(value, builtin_tag<T>());
         }
         
         /*
@@ -100,7 +200,7 @@ namespace bv
         /*
          * Returns a mask word for ask with bits set in the interval [begin, end)
          */
-        template<typename T, REQUIRES(std::is_integral<T>::value)>
+        template<typename T, REQUIRES(is_integer<T>::value)>
         T mask(size_t begin, size_t end)
         {
             constexpr size_t W = bitsize<T>();
@@ -110,7 +210,7 @@ namespace bv
             
             check_valid_range(begin, end, W);
             
-            constexpr T ff = std::numeric_limits<T>::max();
+            constexpr T ff = T(~T(0));
             
             return ((ff << (W - end)) >> (W - end + begin)) << begin;
         }
@@ -119,7 +219,7 @@ namespace bv
         /*
          * Returns the lower n bits in the word
          */
-        template<typename T, REQUIRES(std::is_integral<T>::value)>
+        template<typename T, REQUIRES(is_integer<T>::value)>
         T lowbits(T val, size_t n)
         {
             constexpr size_t W = bitsize<T>();
@@ -134,7 +234,7 @@ namespace bv
          * Returns the higher n bits in the word.
          * Note that bits are not shifted, simply lower bits get masked away.
          */
-        template<typename T, REQUIRES(std::is_integral<T>::value)>
+        template<typename T, REQUIRES(is_integer<T>::value)>
         T highbits(T val, size_t n)
         {
             constexpr size_t W = bitsize<T>();
@@ -148,7 +248,7 @@ namespace bv
         /*
          * Returns the _value_ contained in the bits in the interval [begin, end)
          */
-        template<typename T, REQUIRES(std::is_integral<T>::value)>
+        template<typename T, REQUIRES(is_integer<T>::value)>
         T bitfield(T val, size_t begin, size_t end)
         {
             constexpr size_t W = bitsize<T>();
@@ -179,9 +279,38 @@ namespace bv
             dest = (dest & zeroes) | masked;
         }
         
+        /*
+         * Broadword comparisons between the fields packed into two words.
+         * 'flags' must have a bit set in the highest position of each field.
+         * The results have the flag bit of each field set if the comparison
+         * holds for that pair of fields, and all the other bits cleared.
+         * Fields are compared as unsigned integers using their full width,
+         * so the flag bit is not required to be clear.
+         */
+        template<typename T, REQUIRES(is_integer<T>::value)>
+        T fields_greater_equal(T x, T y, T flags)
+        {
+            // The flag bit of t tells if the lower bits of x are greater or
+            // equal than the lower bits of y. No borrow crosses the fields.
+            T t = (x | flags) - (y & ~flags);
+
+            return ((x & ~y) | (~(x ^ y) & t)) & flags;
+        }
+
+        template<typename T, REQUIRES(is_integer<T>::value)>
+        T fields_equal(T x, T y, T flags)
+        {
+            T z = x ^ y;
+
+            // The flag bit of t is set if the lower bits of z are not zero
+            T t = (z & ~flags) + ~flags;
+
+            return ~(t | z) & flags;
+        }
+
         // Utility function to assert that a word fits in the given bit width.
         // In other words, the value is less than 2^w - 1
-        template<typename T, REQUIRES(std::is_integral<T>::value)>
+        template<typename T, REQUIRES(is_integer<T>::value)>
         bool ensure_bitsize(T value, size_t width)
         {
             assert(lowbits(value, width) == value);
@@ -193,7 +322,7 @@ namespace bv
          * Render the word as a binary string.
          * Every 'sep' bits, the char ssep is printed.
          */
-        template<typename T, REQUIRES(std::is_integral<T>::value)>
+        template<typename T, REQUIRES(is_integer<T>::value)>
         std::string to_binary(T val, size_t sep = 8, char ssep = ' ')
         {
             std::string s;
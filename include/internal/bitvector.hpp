@@ -25,9 +25,9 @@
 #include <deque>
 #include <array>
 #include <cmath>
+#include <string>
+#include <stdexcept>
 #include <type_traits>
-#include <chrono>
-#include <random>
 #include <iomanip>
 
 namespace bv
@@ -43,6 +43,50 @@ namespace bv
         using std::log10;
         using std::tie;
         
+        /*
+         * Bytes allocated by the containers of the bitvector, with their
+         * unused capacity, and whether the figure is exact. Deques allocate
+         * fixed-size blocks, whose size depends on the standard library,
+         * plus a map of pointers to them, which isn't observable, so their
+         * figure is an estimate with the block sizes of libstdc++ and
+         * libc++ and the map at its minimum. With other libraries it's only
+         * the bytes of the elements.
+         */
+        template<typename T>
+        size_t allocated_bytes(std::vector<T> const&v) {
+            return v.capacity() * sizeof(T);
+        }
+        
+        template<typename T>
+        bool exact_allocation(std::vector<T> const&) {
+            return true;
+        }
+        
+        template<typename T>
+        size_t allocated_bytes(std::deque<T> const&d)
+        {
+#if defined(_LIBCPP_VERSION)
+            const size_t block = sizeof(T) < 256 ? 4096 / sizeof(T) : 16;
+            const size_t blocks = ceildiv(d.size(), block);
+            const size_t map = blocks;
+            
+            return blocks * block * sizeof(T) + map * sizeof(T *);
+#elif defined(__GLIBCXX__)
+            const size_t block = sizeof(T) < 512 ? 512 / sizeof(T) : 1;
+            const size_t blocks = d.size() / block + 1;
+            const size_t map = max(size_t(8), blocks + 2);
+            
+            return blocks * block * sizeof(T) + map * sizeof(T *);
+#else
+            return d.size() * sizeof(T);
+#endif
+        }
+        
+        template<typename T>
+        bool exact_allocation(std::deque<T> const&) {
+            return false;
+        }
+        
         /*
          * Private implementation class for bitvector
          */
@@ -133,6 +177,34 @@ namespace bv
             packed_data pointers;
             data_container<leaf_t> leaves;
             
+            using stats_t  = typename bitvector_t<W, AllocPolicy>::stats_t;
+            using report_t = typename bitvector_t<W, AllocPolicy>::report_t;
+            using heatmap_t = typename bitvector_t<W, AllocPolicy>::heatmap_t;
+            
+#ifdef PACKED_BITVECTOR_STATS
+            stats_t stats = stats_t();
+#endif
+            
+#ifdef PACKED_BITVECTOR_TRACE
+            mutable trace_writer tracer;
+#endif
+
+#ifdef PACKED_BITVECTOR_HEATMAP
+            // Sampled hits of each leaf, by index in the leaves array, and
+            // of each depth. The operation in progress is recorded if armed
+            struct heat_t {
+                size_t period = 64;
+                size_t countdown = 64;
+                size_t samples = 0;
+                bool armed = false;
+                bool write = false;
+                std::vector<size_t> depths;
+                std::vector<size_t> reads;
+                std::vector<size_t> writes;
+            };
+            mutable heat_t heat;
+#endif
+
             /*
              * Operations
              */
@@ -140,6 +212,20 @@ namespace bv
             bt_impl(bt_impl const&) = default;
             bt_impl &operator=(bt_impl const&) = default;
             
+            // Parameters of the tree for a capacity and a width of the
+            // nodes, which are valid if the pointers fit in the nodes
+            struct parameters_t {
+                size_t counter_width = 0;
+                size_t degree = 0;
+                size_t buffer = 0;
+                size_t leaves_count = 0;
+                size_t nodes_count = 0;
+                size_t pointer_width = 0;
+                bool valid = false;
+            };
+            
+            static parameters_t parameters(size_t capacity, size_t node_width);
+            
             // Parameters initialization at construction
             bt_impl(size_t capacity, size_t node_width);
             
@@ -161,6 +247,57 @@ namespace bv
             size_t alloc_node();
             size_t alloc_leaf();
             
+            // Adds n to a counter of the statistics, if they are collected
+            void record(size_t stats_t::*counter, size_t n = 1) {
+#ifdef PACKED_BITVECTOR_STATS
+                stats.*counter += n;
+#else
+                unused(counter, n);
+#endif
+            }
+            
+            // Writes an operation to the trace, if it's being recorded
+            void log(trace_op op, size_t index, bool bit = false) const {
+#ifdef PACKED_BITVECTOR_TRACE
+                if(tracer.active())
+                    tracer.write(op, index, bit);
+#else
+                unused(op, index, bit);
+#endif
+            }
+            
+            // Arms the sampling of the heatmap for the operation beginning,
+            // once every period operations
+            void start_sample(bool write) const {
+#ifdef PACKED_BITVECTOR_HEATMAP
+                heat.armed = --heat.countdown == 0;
+                if(heat.armed) {
+                    heat.countdown = heat.period;
+                    heat.write = write;
+                }
+#else
+                unused(write);
+#endif
+            }
+            
+            // Records the subtree where the sampled operation ends, if any
+            void end_sample(subtree_const_ref t) const {
+#ifdef PACKED_BITVECTOR_HEATMAP
+                if(heat.armed)
+                    sample(t);
+#else
+                unused(t);
+#endif
+            }
+            
+            void sample(subtree_const_ref t) const;
+            
+            // Adds the leaves of the subtree to the heatmap, in order
+            void heatmap(subtree_const_ref t, heatmap_t &h) const;
+            
+            // Adds the subtree to the counts of the report
+            void report(subtree_const_ref t, report_t &r) const;
+            
             // Creation of root node ref
             subtree_ref       root();
             subtree_const_ref root() const;
@@ -335,37 +472,19 @@ namespace bv
             //  - The index of the subtree
             //  - The new index, relative to the subtree, where to insert the bit
             //
-            // For the bit tricks used in this step see the paper
+            // The children are counted with the broadword search of
+            // packed_view::count_less(). For the bit tricks see the paper.
             std::pair<size_t, size_t>
             find_insert_point(size_t index) const
             {
                 assert(is_node());
                 
-                using word_type = typename packed_data::word_type;
-                
-                size_t len = degree();
-                const word_type field_mask   = _vector.sizes.field_mask();
-                const word_type flag_mask    = _vector.sizes.flag_mask();
-                const size_t width           = _vector.counter_width;
-                const size_t fields_per_word = _vector.sizes.elements_per_word();
-                const size_t rem             = len % fields_per_word;
-                
-                ensure_bitsize(index, width - 1);
-                
-                size_t child = len;
-                for(size_t step, p = 0; p < degree(); len -= step, p += step)
-                {
-                    step = len < fields_per_word ? rem : fields_per_word;
-                    
-                    word_type word = word_type(sizes(p, p + step)) |
-                                     flag_mask;
-                    
-                    child -= popcount(lowbits(flag_mask &
-                                              (word - index * field_mask),
-                                              step * width));
-                }
+                ensure_bitsize(index, _vector.counter_width - 1);
                 
-                assert(len == 0);
+                size_t child = _vector.sizes.count_less(_index * degree(),
+                                                        _index * degree() +
+                                                        degree(),
+                                                        index);
                 
                 size_t new_index = index;
                 if(child > 0)
@@ -615,56 +734,86 @@ namespace bv
          * Please refer to the paper for a detailed explaination.
          */
         template<size_t W, allocation_policy_t AP>
-        bt_impl<W, AP>::bt_impl(size_t N, size_t Wn)
+        auto bt_impl<W, AP>::parameters(size_t capacity, size_t node_width)
+            -> parameters_t
         {
-            capacity = N;
+            parameters_t p;
             
-            // When all the maximum capacity fits in a leaf, we act consequently
-            if(small()) {
-                // We only need one leaf
-                leaves_count = 1;
-                alloc_leaf();
-                return;
+            // When all the maximum capacity fits in a leaf, we only need one
+            if(capacity <= leaf_bits) {
+                p.leaves_count = 1;
+                p.valid = true;
+                return p;
             }
             
-            node_width = Wn;
-            
             // The + 1 at the end is for the extra flag bit
-            counter_width = size_t(floor(log2(capacity)) + 1) + 1;
+            p.counter_width = size_t(floor(log2(capacity)) + 1) + 1;
+            
+            p.degree = node_width / p.counter_width;
             
-            degree = node_width / counter_width;
+            for(p.buffer = max(size_t(ceil(sqrt(p.degree))), size_t(1));
+                floor((p.degree + 1)/p.buffer) < p.buffer;
+                --p.buffer);
             
-            for(buffer = max(size_t(ceil(sqrt(degree))), size_t(1));
-                floor((degree + 1)/buffer) < buffer;
-                --buffer);
+            // With a buffer of one, nodes could have a single child, and the
+            // height wouldn't be bounded
+            if(p.buffer < 2)
+                return p;
             
             // Maximum number of leaves needed in the worst case
-            leaves_count = size_t(ceil(capacity / ((buffer *
-                                                    (leaf_bits - buffer))
-                                                  / (buffer + 1))))
-                           + 1; // for the sentinel leaf at index 0
+            p.leaves_count = size_t(ceil(capacity / ((p.buffer *
+                                                      (leaf_bits - p.buffer))
+                                                    / (p.buffer + 1))))
+                             + 1; // for the sentinel leaf at index 0
             
-            size_t minimum_degree = buffer;
+            size_t minimum_degree = p.buffer;
             
             // Total number of internal nodes
-            nodes_count = 0;
-            size_t level_count = leaves_count;
+            size_t level_count = p.leaves_count;
             do
             {
                 level_count = ceildiv(level_count, minimum_degree);
-                nodes_count += level_count;
+                p.nodes_count += level_count;
             } while(level_count > 1);
             
             // For values of small capacity relatively to the leaves and nodes
             // bit size, the buffer could be greater than the maximum count.
-            leaves_count = max(leaves_count, buffer + 1);
-            nodes_count = max(nodes_count, buffer + 1);
+            p.leaves_count = max(p.leaves_count, p.buffer + 1);
+            p.nodes_count = max(p.nodes_count, p.buffer + 1);
             
             // Width of pointers
-            pointer_width = size_t(ceil(log2(max(nodes_count, leaves_count))));
+            p.pointer_width = size_t(ceil(log2(max(p.nodes_count,
+                                                   p.leaves_count))));
             
-            assert(pointer_width <= counter_width);
-            assert(pointer_width * (degree + 1) <= node_width);
+            p.valid = p.pointer_width <= p.counter_width &&
+                      p.pointer_width * (p.degree + 1) <= node_width;
+            
+            return p;
+        }
+        
+        template<size_t W, allocation_policy_t AP>
+        bt_impl<W, AP>::bt_impl(size_t N, size_t Wn)
+        {
+            parameters_t p = parameters(N, Wn);
+            if(!p.valid)
+                throw std::invalid_argument(
+                    "bitvector: nodes of " + std::to_string(Wn) + " bits "
+                    "are too narrow for a capacity of " + std::to_string(N));
+            
+            capacity = N;
+            node_width = Wn;
+            counter_width = p.counter_width;
+            degree = p.degree;
+            buffer = p.buffer;
+            leaves_count = p.leaves_count;
+            nodes_count = p.nodes_count;
+            pointer_width = p.pointer_width;
+            
+            // When all the maximum capacity fits in a leaf, we act consequently
+            if(small()) {
+                alloc_leaf();
+                return;
+            }
             
             // Allocate all the needed memory ahead of time if the policy says so
             if(AP == alloc_immediatly) {
@@ -698,6 +847,7 @@ namespace bv
                    "Maximum number of nodes exceeded");
             
             size_t node = free_node++;
+            record(&stats_t::node_allocations);
             
             if(AP == alloc_on_demand)
                 reserve_nodes(used_nodes());
@@ -711,6 +861,7 @@ namespace bv
                    "Maximum number of leaves exceeded");
             
             size_t leaf = free_leaf++;
+            record(&stats_t::leaf_allocations);
             
             if(AP == alloc_on_demand)
                 leaves.resize(used_leaves());
@@ -746,8 +897,10 @@ namespace bv
         {
             assert(index < t.size() && "Index out of bounds");
             
-            if(t.is_leaf()) // We have a leaf
+            if(t.is_leaf()) { // We have a leaf
+                end_sample(t);
                 return t.leaf()[index];
+            }
             else { // We're in a node
                 size_t child, new_index;
                 tie(child, new_index) = t.find(index);
@@ -763,14 +916,20 @@ namespace bv
             assert(index <= t.size() && "Index out of bounds");
             
             // Short circuit for special cases
-            if(index == t.size())
+            if(index == t.size()) {
+                end_sample(t);
                 return t.rank() + prevrank;
+            }
             
-            if(index == 0)
+            if(index == 0) {
+                end_sample(t);
                 return prevrank;
+            }
             
-            if(t.is_leaf())
+            if(t.is_leaf()) {
+                end_sample(t);
                 return t.leaf().popcount(0, index) + prevrank;
+            }
             else {
                 size_t child, new_index;
                 tie(child, new_index) = t.find_insert_point(index);
@@ -793,6 +952,8 @@ namespace bv
             assert(index < t.size() && "Index out of bounds");
             
             if(t.is_leaf()) {
+                end_sample(t);
+                
                 // We have a leaf
                 // We need to read the previous value to know if we have to
                 // update the ranks
@@ -812,9 +973,9 @@ namespace bv
                 
                 bool b = set(t.child(child), new_index, bit);
                 if(b && !bit)
-                    t.ranks(child, degree()) -= 1;
+                    t.ranks(child, degree) -= 1;
                 if(!b && bit)
-                    t.ranks(child, degree()) += 1;
+                    t.ranks(child, degree) += 1;
                 return b;
             }
         }
@@ -863,6 +1024,7 @@ namespace bv
                 
                 // The only point in the algorithm were the height increases
                 ++height;
+                record(&stats_t::root_splits);
                 
                 assert(root().nchildren() == 1);
                 assert(root().child(0).is_full());
@@ -876,6 +1038,8 @@ namespace bv
             // If we're inserting into a leaf, it's very simple.
             if(t.is_leaf())
             {
+                end_sample(t);
+                
                 // 1 - Update the counters
                 size += 1;
                 rank += bit;
@@ -899,8 +1063,10 @@ namespace bv
                 tie(begin, end, count) = find_adjacent_children(t, child);
                 
                 // 2.2 - Check if we need to split or only to redistribute
-                if(count >= split_limit(t))
+                if(count >= split_limit(t)) {
                     t.insert_child(end++);
+                    record(&stats_t::splits);
+                }
                 
                 // 2.3 - Redistribute
                 redistribute(t, begin, end, count);
@@ -922,6 +1088,75 @@ namespace bv
             return insert(child_ref, new_index, bit);
         }
         
+        template<size_t W, allocation_policy_t AP>
+        void bt_impl<W, AP>::report(subtree_const_ref t, report_t &r) const
+        {
+            r.level_nodes[t.height()] += 1;
+            
+            if(t.is_leaf()) {
+                size_t bucket = t.size() * r.leaf_fill.size() / leaf_bits;
+                r.leaf_fill[min(bucket, r.leaf_fill.size() - 1)] += 1;
+                return;
+            }
+            
+            // Children are counted by their pointers, since nchildren()
+            // counts only the ones before the last bit
+            size_t children = 0;
+            for(size_t k = 0; k <= degree; ++k) {
+                if(t.pointers(k) != 0) {
+                    children += 1;
+                    report(t.child(k), r);
+                }
+            }
+            
+            r.children[children] += 1;
+        }
+        
+        template<size_t W, allocation_policy_t AP>
+        void bt_impl<W, AP>::sample(subtree_const_ref t) const
+        {
+#ifdef PACKED_BITVECTOR_HEATMAP
+            heat.armed = false;
+            heat.samples += 1;
+            
+            size_t depth = height - t.height();
+            if(heat.depths.size() <= depth)
+                heat.depths.resize(depth + 1);
+            heat.depths[depth] += 1;
+            
+            if(t.is_leaf()) {
+                std::vector<size_t> &hits = heat.write ? heat.writes
+                                                       : heat.reads;
+                if(hits.size() <= t.index())
+                    hits.resize(leaves.size());
+                hits[t.index()] += 1;
+            }
+#else
+            unused(t);
+#endif
+        }
+        
+        template<size_t W, allocation_policy_t AP>
+        void bt_impl<W, AP>::heatmap(subtree_const_ref t, heatmap_t &h) const
+        {
+#ifdef PACKED_BITVECTOR_HEATMAP
+            if(t.is_leaf()) {
+                auto hits = [&](std::vector<size_t> const&v) {
+                    return t.index() < v.size() ? v[t.index()] : 0;
+                };
+                h.leaves.push_back({ t.index(), t.size(),
+                                     hits(heat.reads), hits(heat.writes) });
+                return;
+            }
+            
+            for(size_t k = 0; k <= degree; ++k)
+                if(t.pointers(k) != 0)
+                    heatmap(t.child(k), h);
+#else
+            unused(t, h);
+#endif
+        }
+        
         // Utility functions for insert()
         
         // Find the group of children adjacent to 'child',
@@ -1046,6 +1281,11 @@ namespace bv
             // subsequently redistribute them to the leaves
             bitview<std::vector> bits(count);
             
+            record(&stats_t::leaf_redistributions);
+            record(&stats_t::bits_moved, count);
+            record(&stats_t::buffer_bytes,
+                   bits.container().size() * sizeof(bits.container()[0]));
+            
             for(size_t i = begin, p = 0; i < end; ++i) {
                 if(t.pointers(i) != 0) {
                     size_t step = t.child(i).size();
@@ -1135,6 +1375,11 @@ namespace bv
                 }
             }
             
+            record(&stats_t::node_redistributions);
+            record(&stats_t::keys_moved, ptrs.size());
+            record(&stats_t::buffer_bytes,
+                   ptrs.capacity() * sizeof(pointer));
+            
             clear_children_counters(t, begin, end);
             
             for(size_t p = 0, i = begin; i != end; ++i)
@@ -1189,6 +1434,15 @@ namespace bv
     bitvector_t<W, AP>::bitvector_t(size_t capacity, size_t node_width)
         : _impl(new internal::bt_impl<W, AP>(capacity, node_width)) { }
     
+    template<size_t W, allocation_policy_t AP>
+    inline
+    bool bitvector_t<W, AP>::valid_node_width(size_t capacity,
+                                              size_t node_width)
+    {
+        return internal::bt_impl<W, AP>::parameters(capacity,
+                                                     node_width).valid;
+    }
+    
     template<size_t W, allocation_policy_t AP>
     inline
     bitvector_t<W, AP>::bitvector_t(bitvector_t const&other)
@@ -1246,6 +1500,8 @@ namespace bv
     bool bitvector_t<W, AP>::access(size_t index) const {
         assert(valid() && "Can't access an uninitialized vector");
         assert(index < size() && "Index out of bounds");
+        _impl->log(internal::trace_op::access, index);
+        _impl->start_sample(false);
         return _impl->access(_impl->root(), index);
     }
     
@@ -1254,6 +1510,8 @@ namespace bv
     size_t bitvector_t<W, AP>::rank(size_t index, bool bit) const
     {
         assert(valid() && "Can't access an uninitialized vector");
+        _impl->log(internal::trace_op::rank, index, bit);
+        _impl->start_sample(false);
         size_t rank = _impl->getrank(_impl->root(), index, 0);
 
         if(!bit)
@@ -1266,13 +1524,17 @@ namespace bv
     inline
     void bitvector_t<W, AP>::set(size_t index, bool bit) {
         assert(valid() && "Can't access an uninitialized vector");
-        return _impl->set(_impl->root(), index, bit);
+        _impl->log(internal::trace_op::set, index, bit);
+        _impl->start_sample(true);
+        _impl->set(_impl->root(), index, bit);
     }
     
     template<size_t W, allocation_policy_t AP>
     inline
     void bitvector_t<W, AP>::insert(size_t index, bool bit) {
         assert(valid() && "Can't access an uninitialized vector");
+        _impl->log(internal::trace_op::insert, index, bit);
+        _impl->start_sample(true);
         _impl->insert(_impl->root(), index, bit);
     }
     
@@ -1362,110 +1624,159 @@ namespace bv
      * Test and debugging functions
      */
     template<size_t W, allocation_policy_t AP>
-    void bitvector_t<W, AP>::test(std::ostream &stream, size_t N, size_t Wn,
-                                  bool random,
-                                  bool testrank, bool dumpinfo, bool dumpnode,
-                                  bool dumpcontents)
+    inline
+    auto bitvector_t<W, AP>::info() const -> info_t
     {
-        using std::chrono::high_resolution_clock;
-        using std::chrono::duration_cast;
-        using std::chrono::duration;
-        
-        bitvector_t v(N, Wn);
+        assert(valid() && "Can't access an uninitialized vector");
+        return { _impl->capacity,
+                 _impl->size,
+                 _impl->height,
+                 _impl->node_width,
+                 _impl->counter_width,
+                 _impl->pointer_width,
+                 _impl->degree,
+                 _impl->buffer,
+                 _impl->sizes.size() / std::max(_impl->degree, size_t(1)),
+                 _impl->leaves.size()
+        };
+    }
+    
+    template<size_t W, allocation_policy_t AP>
+    inline
+    auto bitvector_t<W, AP>::stats() const -> stats_t
+    {
+        assert(valid() && "Can't access an uninitialized vector");
+#ifdef PACKED_BITVECTOR_STATS
+        stats_t s = _impl->stats;
+        s.enabled = true;
+        return s;
+#else
+        return stats_t();
+#endif
+    }
+    
+    template<size_t W, allocation_policy_t AP>
+    inline
+    void bitvector_t<W, AP>::reset_stats()
+    {
+        assert(valid() && "Can't access an uninitialized vector");
+#ifdef PACKED_BITVECTOR_STATS
+        _impl->stats = stats_t();
+#endif
+    }
+    
+    template<size_t W, allocation_policy_t AP>
+    inline
+    auto bitvector_t<W, AP>::report() const -> report_t
+    {
+        assert(valid() && "Can't access an uninitialized vector");
         
-        if(dumpinfo)
-            stream << v << "\n";
+        auto const&impl = *_impl;
         
-        assert(v.empty());
+        report_t r;
+        r.level_nodes.assign(impl.height + 1, 0);
+        r.children.assign(impl.small() ? 0 : impl.degree + 2, 0);
+        r.leaf_fill.fill(0);
         
-        size_t nbits = N;
+        impl.report(impl.root(), r);
         
-        std::mt19937 engine(42);
-        std::vector<std::pair<size_t, bool>> indexes;
-        bool b = true;
-        for(size_t i = 0; i < nbits; ++i) {
-            std::uniform_int_distribution<size_t> dist(0, i);
-            indexes.emplace_back(random ? dist(engine) : i, b = !b);
-        }
+        auto fields = [&](size_t n, size_t width) {
+            return internal::ceildiv(impl.used_nodes() * n * width, 8);
+        };
         
-        auto t1 = high_resolution_clock::now();
-        for(size_t i = 0; i < nbits - 1; ++i)
-            v.insert(indexes.at(i).first, indexes.at(i).second);
-        v.insert(indexes.at(nbits - 1).first, indexes.at(nbits - 1).second);
-        auto t2 = high_resolution_clock::now();
+        auto const&sizes = impl.sizes.container();
+        auto const&ranks = impl.ranks.container();
+        auto const&pointers = impl.pointers.container();
         
-        assert(v.full());
+        r.sizes = { fields(impl.degree, impl.counter_width),
+                    internal::allocated_bytes(sizes),
+                    internal::exact_allocation(sizes) };
+        r.ranks = { fields(impl.degree, impl.counter_width),
+                    internal::allocated_bytes(ranks),
+                    internal::exact_allocation(ranks) };
+        r.pointers = { fields(impl.degree + 1, impl.pointer_width),
+                       internal::allocated_bytes(pointers),
+                       internal::exact_allocation(pointers) };
+        r.leaves = { impl.used_leaves() * sizeof(impl.leaves[0]),
+                     internal::allocated_bytes(impl.leaves),
+                     internal::exact_allocation(impl.leaves) };
         
-        if(dumpnode) {
-            stream << "\n" << v._impl->root() << "\n";
-            if(v._impl->root().height() > 1) {
-                for(size_t i = 0; i < v._impl->root().nchildren(); ++i) {
-                    if(v._impl->root().pointers(i) == 0)
-                        stream << "Child " << i << " is null\n";
-                    else
-                        stream << v._impl->root().child(i) << "\n";
-                }
-            }
-        }
+        r.bytes = sizeof(*this) + sizeof(impl) + r.sizes.allocated +
+                  r.ranks.allocated + r.pointers.allocated +
+                  r.leaves.allocated;
+        r.exact = r.sizes.exact && r.ranks.exact && r.pointers.exact &&
+                  r.leaves.exact;
         
-        if(testrank || dumpcontents) {
-            size_t ranki = nbits/2;
-            size_t rank = 0;
-            size_t totalrank = 0;
-            for(size_t i = 0; i < nbits; ++i) {
-                bool b = v.access(i);
-                if(b) {
-                    if(i < ranki)
-                        ++rank;
-                    ++totalrank;
-                }
-                
-                if (dumpcontents) {
-                    if(i && i % 8 == 0)
-                        stream << " ";
-                    if(i && i % 64 == 0)
-                        stream << "\n";
-                    stream << b;
-                }
-            }
-            size_t r1 = v.rank(ranki);
-            size_t r2 = v.rank(nbits);
-            if(r1 != rank)
-                stream << "FAIL: rank should be " << rank << ",\n"
-                       << "               found " << r1 << "\n";
-            
-            if(r2 != totalrank)
-                stream << "FAIL: total rank should be " << totalrank << ",\n"
-                       << "                     found " << r2 << "\n";
-        }
+        return r;
+    }
+    
+    template<size_t W, allocation_policy_t AP>
+    inline
+    auto bitvector_t<W, AP>::heatmap() const -> heatmap_t
+    {
+        assert(valid() && "Can't access an uninitialized vector");
         
-        if(dumpcontents)
-            stream << "\n\n";
+        heatmap_t h = heatmap_t();
+#ifdef PACKED_BITVECTOR_HEATMAP
+        h.enabled = true;
+        h.period = _impl->heat.period;
+        h.samples = _impl->heat.samples;
+        h.depths = _impl->heat.depths;
+        h.depths.resize(_impl->height + 1);
         
+        _impl->heatmap(_impl->root(), h);
+#endif
+        return h;
+    }
+    
+    template<size_t W, allocation_policy_t AP>
+    inline
+    void bitvector_t<W, AP>::reset_heatmap(size_t period)
+    {
+        assert(valid() && "Can't access an uninitialized vector");
+        assert(period > 0 && "The sampling period must be positive");
+#ifdef PACKED_BITVECTOR_HEATMAP
+        _impl->heat = typename internal::bt_impl<W, AP>::heat_t();
+        _impl->heat.period = period;
+        _impl->heat.countdown = period;
+#else
+        internal::unused(period);
+#endif
+    }
+    
+    template<size_t W, allocation_policy_t AP>
+    inline
+    void bitvector_t<W, AP>::heatmap_t::dump(std::ostream &out) const
+    {
+        out << "# 1 sample every " << period << " operations, "
+            << samples << " samples\n"
+            << "# depth samples\n";
+        for(size_t d = 0; d < depths.size(); ++d)
+            out << d << " " << depths[d] << "\n";
         
-        double total = duration_cast<duration<double, std::ratio<1>>>(t2 - t1).count();
-        stream << "Inserted " << nbits << " bits (Wn = " << Wn << ") in "
-               << total << "s\n";
-        stream << "Used " << v.memory() << " bits of memory\n";
-        stream << "Height: " << v.info().height << "\n";
+        out << "# leaf index bits reads writes\n";
+        for(size_t i = 0; i < leaves.size(); ++i)
+            out << i << " " << leaves[i].index << " " << leaves[i].bits
+                << " " << leaves[i].reads << " " << leaves[i].writes << "\n";
     }
     
     template<size_t W, allocation_policy_t AP>
     inline
-    auto bitvector_t<W, AP>::info() const -> info_t
+    bool bitvector_t<W, AP>::trace(std::ostream *out)
     {
         assert(valid() && "Can't access an uninitialized vector");
-        return { _impl->capacity,
-                 _impl->size,
-                 _impl->height,
-                 _impl->node_width,
-                 _impl->counter_width,
-                 _impl->pointer_width,
-                 _impl->degree,
-                 _impl->buffer,
-                 _impl->sizes.size() / std::max(_impl->degree, size_t(1)),
-                 _impl->leaves.size()
-        };
+#ifdef PACKED_BITVECTOR_TRACE
+        trace_header h = { capacity(), _impl->node_width, W, { } };
+        if(out)
+            for(size_t i = 0; i < size(); ++i)
+                h.initial.push_back(_impl->access(_impl->root(), i));
+        
+        _impl->tracer.start(out, h);
+        return true;
+#else
+        internal::unused(out);
+        return false;
+#endif
     }
     
     template<size_t W, allocation_policy_t AP>
@@ -1474,7 +1785,7 @@ namespace bv
     {
         assert(valid() && "Can't access an uninitialized vector");
         constexpr size_t nodes_word_size =
-                         internal::bitsize<internal::bitview_base::word_type>();
+                         internal::bitsize<internal::bitview_base<>::word_type>();
         
         size_t m = sizeof(internal::bt_impl<W, AP>) * 8;
         m += _impl->sizes.container().size() * nodes_word_size;
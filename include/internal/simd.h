@@ -0,0 +1,514 @@
+/*
+ * Copyright 2014 Nicola Gigante
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PACKED_BITVECTOR_SIMD_H
+#define PACKED_BITVECTOR_SIMD_H
+
+#include "bits.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+
+#if defined(__AVX2__) || defined(__BMI2__)
+#include <immintrin.h>
+#endif
+
+/*
+ * Kernels working on plain arrays of words.
+ *
+ * They are used by bitview and packed_view for the bulk of an operation
+ * when the underlying container stores its words contiguously (see
+ * is_contiguous in bits.h). The generic versions are simple loops. When the
+ * code is compiled with AVX2 enabled (e.g. with ARCH=haswell), the uint64_t
+ * overloads process four words at a time.
+ */
+namespace bv
+{
+    namespace internal {
+        
+        /*
+         * Extraction of n fields of the given width, at consecutive positions
+         * starting from bit 'begin' of the array of 'size' words. They return
+         * the number of fields extracted, which can be less than n, and zero
+         * if there's no vectorized implementation for these arguments.
+         */
+        template<typename W, typename T>
+        size_t unpack_fields(W const*, size_t, size_t, size_t, T *, size_t) {
+            return 0;
+        }
+        
+        /*
+         * Extraction of n ranges of len bits, beginning at the positions
+         * listed in begins, from the array of 'size' words. The return value
+         * is as for unpack_fields(). The words of the range prefetch_distance
+         * places ahead are prefetched, to overlap the cache misses of
+         * consecutive ranges at random positions.
+         */
+        constexpr size_t prefetch_distance = 32;
+        
+        template<typename W, typename T>
+        size_t gather_ranges(W const*, size_t, size_t const*, size_t,
+                             T *, size_t)
+        {
+            return 0;
+        }
+        
+        template<typename T>
+        void add_words(T *dest, T value, size_t n) {
+            for(size_t i = 0; i < n; ++i)
+                dest[i] += value;
+        }
+        
+        template<typename T>
+        void sub_words(T *dest, T value, size_t n) {
+            for(size_t i = 0; i < n; ++i)
+                dest[i] -= value;
+        }
+        
+        template<typename T>
+        void add_words(T *dest, T const*src, size_t n) {
+            for(size_t i = 0; i < n; ++i)
+                dest[i] += src[i];
+        }
+        
+        template<typename T>
+        void sub_words(T *dest, T const*src, size_t n) {
+            for(size_t i = 0; i < n; ++i)
+                dest[i] -= src[i];
+        }
+
+        /*
+         * Fills the n words of dest with the bits of src starting from bit
+         * 'shift' of its first word, that is with a funnel shift of each
+         * pair of consecutive source words. The shift must not be zero, and
+         * src must have n + 1 words. The forward version can be used if dest
+         * comes before src, the backward one if it comes after, even when
+         * they overlap. dest and src can be pointers or random access
+         * iterators.
+         */
+        template<typename D, typename S>
+        void funnel_words(D dest, S src, size_t n, size_t shift)
+        {
+            using T = typename std::iterator_traits<D>::value_type;
+            constexpr size_t W = sizeof(T) * 8;
+            
+            for(size_t i = 0; i < n; ++i)
+                dest[i] = T(src[i] >> shift) | T(src[i + 1] << (W - shift));
+        }
+        
+        template<typename D, typename S>
+        void funnel_words_backward(D dest, S src, size_t n, size_t shift)
+        {
+            using T = typename std::iterator_traits<D>::value_type;
+            constexpr size_t W = sizeof(T) * 8;
+            
+            for(size_t i = n; i-- > 0;)
+                dest[i] = T(src[i] >> shift) | T(src[i + 1] << (W - shift));
+        }
+
+        /*
+         * Bitwise operations used by combine_words() below
+         */
+        struct and_op {
+            template<typename T>
+            T operator()(T a, T b) const { return a & b; }
+        };
+        
+        struct or_op {
+            template<typename T>
+            T operator()(T a, T b) const { return a | b; }
+        };
+        
+        struct xor_op {
+            template<typename T>
+            T operator()(T a, T b) const { return a ^ b; }
+        };
+        
+        struct andnot_op {
+            template<typename T>
+            T operator()(T a, T b) const { return a & ~b; }
+        };
+        
+        /*
+         * Replaces each of the n words of dest with op(dest[i], s), where s
+         * are the words of src starting from bit 'shift' of its first word,
+         * as in funnel_words(), except that here the shift can be zero.
+         * popcount_and_words() instead counts the bits set in dest[i] & s.
+         */
+        template<typename D, typename S, typename Op>
+        void combine_words(D dest, S src, size_t n, size_t shift, Op op)
+        {
+            using T = typename std::iterator_traits<D>::value_type;
+            constexpr size_t W = sizeof(T) * 8;
+            
+            if(shift == 0) {
+                for(size_t i = 0; i < n; ++i)
+                    dest[i] = op(T(dest[i]), T(src[i]));
+                return;
+            }
+            
+            for(size_t i = 0; i < n; ++i)
+                dest[i] = op(T(dest[i]),
+                             T(src[i] >> shift) | T(src[i + 1] << (W - shift)));
+        }
+        
+        template<typename D, typename S>
+        size_t popcount_and_words(D dest, S src, size_t n, size_t shift)
+        {
+            using T = typename std::iterator_traits<D>::value_type;
+            constexpr size_t W = sizeof(T) * 8;
+            
+            size_t count = 0;
+            for(size_t i = 0; i < n; ++i) {
+                T s = shift == 0 ? T(src[i]) :
+                      T(src[i] >> shift) | T(src[i + 1] << (W - shift));
+                count += popcount(T(dest[i] & s));
+            }
+            
+            return count;
+        }
+
+#if defined(__AVX2__)
+        inline __m256i load_words(uint64_t const*p) {
+            return _mm256_loadu_si256(reinterpret_cast<__m256i const*>(p));
+        }
+        
+        inline void store_words(uint64_t *p, __m256i v) {
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(p), v);
+        }
+        
+        inline void add_words(uint64_t *dest, uint64_t value, size_t n)
+        {
+            const __m256i v = _mm256_set1_epi64x(static_cast<long long>(value));
+            
+            uint64_t *end = dest + n;
+            for(; end - dest >= 4; dest += 4)
+                store_words(dest, _mm256_add_epi64(load_words(dest), v));
+            for(; dest != end; ++dest)
+                *dest += value;
+        }
+        
+        inline void sub_words(uint64_t *dest, uint64_t value, size_t n)
+        {
+            const __m256i v = _mm256_set1_epi64x(static_cast<long long>(value));
+            
+            uint64_t *end = dest + n;
+            for(; end - dest >= 4; dest += 4)
+                store_words(dest, _mm256_sub_epi64(load_words(dest), v));
+            for(; dest != end; ++dest)
+                *dest -= value;
+        }
+        
+        inline void add_words(uint64_t *dest, uint64_t const*src, size_t n)
+        {
+            uint64_t *end = dest + n;
+            for(; end - dest >= 4; dest += 4, src += 4)
+                store_words(dest, _mm256_add_epi64(load_words(dest),
+                                                   load_words(src)));
+            for(; dest != end; ++dest, ++src)
+                *dest += *src;
+        }
+        
+        inline void sub_words(uint64_t *dest, uint64_t const*src, size_t n)
+        {
+            uint64_t *end = dest + n;
+            for(; end - dest >= 4; dest += 4, src += 4)
+                store_words(dest, _mm256_sub_epi64(load_words(dest),
+                                                   load_words(src)));
+            for(; dest != end; ++dest, ++src)
+                *dest -= *src;
+        }
+        
+        inline __m256i funnel_shift(uint64_t const*src,
+                                    __m128i right, __m128i left)
+        {
+            return _mm256_or_si256(_mm256_srl_epi64(load_words(src), right),
+                                   _mm256_sll_epi64(load_words(src + 1), left));
+        }
+        
+        // Both loads of each step come before its store, so overlapping
+        // arrays are handled as in the scalar loops
+        inline void funnel_words(uint64_t *dest, uint64_t const*src,
+                                 size_t n, size_t shift)
+        {
+            const __m128i right = _mm_cvtsi64_si128(static_cast<long long>(shift));
+            const __m128i left  = _mm_cvtsi64_si128(static_cast<long long>(64 - shift));
+            
+            uint64_t *end = dest + n;
+            for(; end - dest >= 4; dest += 4, src += 4)
+                store_words(dest, funnel_shift(src, right, left));
+            for(; dest != end; ++dest, ++src)
+                *dest = (src[0] >> shift) | (src[1] << (64 - shift));
+        }
+        
+        inline void funnel_words_backward(uint64_t *dest, uint64_t const*src,
+                                          size_t n, size_t shift)
+        {
+            const __m128i right = _mm_cvtsi64_si128(static_cast<long long>(shift));
+            const __m128i left  = _mm_cvtsi64_si128(static_cast<long long>(64 - shift));
+            
+            uint64_t *end = dest + n;
+            src += n;
+            for(; end - dest >= 4; end -= 4, src -= 4)
+                store_words(end - 4, funnel_shift(src - 4, right, left));
+            for(; end != dest; --end, --src)
+                end[-1] = (src[-1] >> shift) | (src[0] << (64 - shift));
+        }
+        /*
+         * Loads the four words starting from bit 'shift' of src, reading
+         * also the fifth word if the shift is not zero
+         */
+        inline __m256i load_shifted(uint64_t const*src, size_t shift,
+                                    __m128i right, __m128i left)
+        {
+            return shift == 0 ? load_words(src)
+                              : funnel_shift(src, right, left);
+        }
+        
+        inline __m256i apply(and_op, __m256i a, __m256i b) {
+            return _mm256_and_si256(a, b);
+        }
+        
+        inline __m256i apply(or_op, __m256i a, __m256i b) {
+            return _mm256_or_si256(a, b);
+        }
+        
+        inline __m256i apply(xor_op, __m256i a, __m256i b) {
+            return _mm256_xor_si256(a, b);
+        }
+        
+        inline __m256i apply(andnot_op, __m256i a, __m256i b) {
+            return _mm256_andnot_si256(b, a);
+        }
+        
+        template<typename Op>
+        void combine_words(uint64_t *dest, uint64_t const*src,
+                           size_t n, size_t shift, Op op)
+        {
+            const __m128i right = _mm_cvtsi64_si128(static_cast<long long>(shift));
+            const __m128i left  = _mm_cvtsi64_si128(static_cast<long long>(64 - shift));
+            
+            uint64_t *end = dest + n;
+            for(; end - dest >= 4; dest += 4, src += 4)
+                store_words(dest, apply(op, load_words(dest),
+                                        load_shifted(src, shift, right, left)));
+            
+            combine_words<uint64_t *, uint64_t const*>(dest, src, size_t(end - dest),
+                                                      shift, op);
+        }
+        
+        /*
+         * Number of bits set in each of the four words, by looking up
+         * the count of each nibble (Mula's algorithm)
+         */
+        inline __m256i popcount_lanes(__m256i v)
+        {
+            const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3,
+                                                    1, 2, 2, 3, 2, 3, 3, 4,
+                                                    0, 1, 1, 2, 1, 2, 2, 3,
+                                                    1, 2, 2, 3, 2, 3, 3, 4);
+            const __m256i nibble = _mm256_set1_epi8(0x0f);
+            
+            __m256i lo = _mm256_shuffle_epi8(lookup,
+                                             _mm256_and_si256(v, nibble));
+            __m256i hi = _mm256_shuffle_epi8(lookup,
+                             _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble));
+            
+            return _mm256_sad_epu8(_mm256_add_epi8(lo, hi),
+                                   _mm256_setzero_si256());
+        }
+        
+        inline size_t popcount_and_words(uint64_t const*dest,
+                                         uint64_t const*src,
+                                         size_t n, size_t shift)
+        {
+            const __m128i right = _mm_cvtsi64_si128(static_cast<long long>(shift));
+            const __m128i left  = _mm_cvtsi64_si128(static_cast<long long>(64 - shift));
+            
+            __m256i counts = _mm256_setzero_si256();
+            
+            uint64_t const*end = dest + n;
+            for(; end - dest >= 4; dest += 4, src += 4) {
+                __m256i s = load_shifted(src, shift, right, left);
+                __m256i d = _mm256_loadu_si256(
+                                reinterpret_cast<__m256i const*>(dest));
+                
+                counts = _mm256_add_epi64(counts,
+                             popcount_lanes(_mm256_and_si256(d, s)));
+            }
+            
+            uint64_t lanes[4];
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(lanes), counts);
+            
+            return size_t(lanes[0] + lanes[1] + lanes[2] + lanes[3]) +
+                   popcount_and_words<uint64_t const*, uint64_t const*>(
+                       dest, src, size_t(end - dest), shift);
+        }
+        
+        /*
+         * Each field is loaded with a gather from the address of the byte
+         * containing its first bit, and then shifted in place. The loop stops
+         * before the loads would cross the end of the array.
+         */
+        inline size_t unpack_fields(uint64_t const*words, size_t size,
+                                    size_t begin, size_t width,
+                                    uint64_t *out, size_t n)
+        {
+            // The field must fit into the eight bytes loaded
+            if(width > 57)
+                return 0;
+            
+            auto bytes = reinterpret_cast<unsigned char const*>(words);
+            const long long w = static_cast<long long>(width);
+            const __m256i steps = _mm256_setr_epi64x(0, w, 2 * w, 3 * w);
+            const __m256i seven = _mm256_set1_epi64x(7);
+            const __m256i mask  = _mm256_set1_epi64x((1LL << w) - 1);
+            
+            size_t i = 0;
+            for(; i + 4 <= n; i += 4)
+            {
+                size_t p = begin + i * width;
+                if((p + 3 * width) / 8 + 8 > size * 8)
+                    break;
+                
+                __m256i pos = _mm256_add_epi64(
+                                  _mm256_set1_epi64x(static_cast<long long>(p % 8)),
+                                  steps);
+                __m256i v = _mm256_i64gather_epi64(
+                                reinterpret_cast<long long const*>(bytes + p / 8),
+                                _mm256_srli_epi64(pos, 3), 1);
+                
+                v = _mm256_srlv_epi64(v, _mm256_and_si256(pos, seven));
+                store_words(out + i, _mm256_and_si256(v, mask));
+            }
+            
+            return i;
+        }
+        
+        inline size_t unpack_fields(uint64_t const*words, size_t size,
+                                    size_t begin, size_t width,
+                                    uint32_t *out, size_t n)
+        {
+            // The field must fit into the four bytes loaded
+            if(width > 25)
+                return 0;
+            
+            auto bytes = reinterpret_cast<unsigned char const*>(words);
+            const int w = static_cast<int>(width);
+            const __m256i steps = _mm256_setr_epi32(0, w, 2 * w, 3 * w,
+                                                    4 * w, 5 * w, 6 * w, 7 * w);
+            const __m256i seven = _mm256_set1_epi32(7);
+            const __m256i mask  = _mm256_set1_epi32((1 << w) - 1);
+            
+            size_t i = 0;
+            for(; i + 8 <= n; i += 8)
+            {
+                size_t p = begin + i * width;
+                if((p + 7 * width) / 8 + 4 > size * 8)
+                    break;
+                
+                __m256i pos = _mm256_add_epi32(
+                                  _mm256_set1_epi32(static_cast<int>(p % 8)),
+                                  steps);
+                __m256i v = _mm256_i32gather_epi32(
+                                reinterpret_cast<int const*>(bytes + p / 8),
+                                _mm256_srli_epi32(pos, 3), 1);
+                
+                v = _mm256_srlv_epi32(v, _mm256_and_si256(pos, seven));
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i),
+                                    _mm256_and_si256(v, mask));
+            }
+            
+            return i;
+        }
+        
+        /*
+         * Each range is the low word, shifted right, merged with the next
+         * word, shifted left. The next word is gathered even if the range
+         * doesn't reach it, and then shifted away or masked out, but it's
+         * clamped to the last one to not load past the end of the array.
+         */
+        inline size_t gather_ranges(uint64_t const*words, size_t size,
+                                    size_t const*begins, size_t len,
+                                    uint64_t *out, size_t n)
+        {
+            static_assert(sizeof(size_t) == sizeof(uint64_t),
+                          "Positions are loaded as 64 bits lanes");
+            
+            if(size == 0)
+                return 0;
+            
+            auto base = reinterpret_cast<long long const*>(words);
+            const __m256i one   = _mm256_set1_epi64x(1);
+            const __m256i bits  = _mm256_set1_epi64x(64);
+            const __m256i low   = _mm256_set1_epi64x(63);
+            const __m256i last  = _mm256_set1_epi64x(static_cast<long long>(size - 1));
+            const __m256i mask  = _mm256_set1_epi64x(len == 64 ? -1LL
+                                                               : (1LL << len) - 1);
+            
+            size_t i = 0;
+            for(; i + 4 <= n; i += 4)
+            {
+                if(i + prefetch_distance + 4 <= n)
+                    for(size_t k = 0; k < 4; ++k)
+                        __builtin_prefetch(words +
+                                           begins[i + prefetch_distance + k] / 64);
+                
+                __m256i pos = _mm256_loadu_si256(
+                                  reinterpret_cast<__m256i const*>(begins + i));
+                __m256i index = _mm256_srli_epi64(pos, 6);
+                __m256i shift = _mm256_and_si256(pos, low);
+                
+                __m256i next = _mm256_add_epi64(index, one);
+                next = _mm256_blendv_epi8(next, last,
+                                          _mm256_cmpgt_epi64(next, last));
+                
+                __m256i lo = _mm256_i64gather_epi64(base, index, 8);
+                __m256i hi = _mm256_i64gather_epi64(base, next, 8);
+                
+                // A shift by 64 bits gives zero, for ranges beginning a word
+                __m256i v = _mm256_or_si256(
+                                _mm256_srlv_epi64(lo, shift),
+                                _mm256_sllv_epi64(hi, _mm256_sub_epi64(bits,
+                                                                       shift)));
+                
+                store_words(out + i, _mm256_and_si256(v, mask));
+            }
+            
+            return i;
+        }
+#endif
+
+#if defined(__BMI2__)
+        /*
+         * Spreading and gathering of bits under a mask, used to move two
+         * fields at once between the packed representation and a pair of
+         * uint32_t, and many fields at once when repacking them
+         */
+        inline uint64_t deposit_bits(uint64_t value, uint64_t mask) {
+            return _pdep_u64(value, mask);
+        }
+        
+        inline uint64_t extract_bits(uint64_t value, uint64_t mask) {
+            return _pext_u64(value, mask);
+        }
+#endif
+
+    } // namespace internal
+} // namespace bv
+
+#endif
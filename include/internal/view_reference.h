@@ -142,6 +142,90 @@ namespace bv {
                 return *this;
             }
             
+            /*
+             * Element-wise sum and difference with another range. They are
+             * available only if the underlying class implements add() and
+             * subtract()
+             */
+            template<typename C1>
+            range_reference const&
+            operator+=(const_range_reference<C1> const&ref) const
+            {
+                _v.add(ref._v, ref._begin, ref._end, _begin, _end);
+                
+                return *this;
+            }
+            
+            template<typename C1>
+            range_reference const&operator+=(range_reference<C1> const&ref) const
+            {
+                return operator+=(const_range_reference<C1>(ref));
+            }
+            
+            template<typename C1>
+            range_reference const&
+            operator-=(const_range_reference<C1> const&ref) const
+            {
+                _v.subtract(ref._v, ref._begin, ref._end, _begin, _end);
+                
+                return *this;
+            }
+            
+            template<typename C1>
+            range_reference const&operator-=(range_reference<C1> const&ref) const
+            {
+                return operator-=(const_range_reference<C1>(ref));
+            }
+            
+            /*
+             * Bitwise operations with another range, available only if the
+             * underlying class implements and_with(), or_with() and xor_with()
+             */
+            template<typename C1>
+            range_reference const&
+            operator&=(const_range_reference<C1> const&ref) const
+            {
+                _v.and_with(ref._v, ref._begin, ref._end, _begin, _end);
+                
+                return *this;
+            }
+            
+            template<typename C1>
+            range_reference const&operator&=(range_reference<C1> const&ref) const
+            {
+                return operator&=(const_range_reference<C1>(ref));
+            }
+            
+            template<typename C1>
+            range_reference const&
+            operator|=(const_range_reference<C1> const&ref) const
+            {
+                _v.or_with(ref._v, ref._begin, ref._end, _begin, _end);
+                
+                return *this;
+            }
+            
+            template<typename C1>
+            range_reference const&operator|=(range_reference<C1> const&ref) const
+            {
+                return operator|=(const_range_reference<C1>(ref));
+            }
+            
+            template<typename C1>
+            range_reference const&
+            operator^=(const_range_reference<C1> const&ref) const
+            {
+                _v.xor_with(ref._v, ref._begin, ref._end, _begin, _end);
+                
+                return *this;
+            }
+            
+            template<typename C1>
+            range_reference const&operator^=(range_reference<C1> const&ref) const
+            {
+                return operator^=(const_range_reference<C1>(ref));
+            }
+            
             explicit operator word_type() const {
                 return word_type(const_range_reference<C>(*this));
             }
@@ -0,0 +1,372 @@
+/*
+ * Copyright 2014 Nicola Gigante
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PACKED_BITVECTOR_MMAP_VECTOR_H
+#define PACKED_BITVECTOR_MMAP_VECTOR_H
+
+#include "internal/bits.h"
+
+#include <cstddef>
+#include <cstring>
+#include <cerrno>
+#include <cassert>
+#include <string>
+#include <iterator>
+#include <system_error>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace bv
+{
+    namespace internal {
+        
+        /*
+         * Growable container of trivially copyable elements stored in a
+         * memory mapping, which can be used as the Container of a
+         * bitview or a packed_view. POSIX only.
+         *
+         * If built with a path, the elements live in that file, which is
+         * created if it doesn't exist and otherwise keeps its contents, so
+         * the data persists across runs and is shared through the page
+         * cache. Otherwise the mapping is anonymous.
+         * Growing the container extends the file with ftruncate() and
+         * remaps it, in large steps, so the elements can move just like in
+         * a std::vector. While mapped, the file is as large as capacity(),
+         * and it's cut back to size() when the container is destroyed.
+         *
+         * Errors of the system calls are thrown as std::system_error.
+         */
+        template<typename T>
+        class mmap_vector
+        {
+            static_assert(std::is_trivially_copyable<T>::value,
+                          "mmap_vector elements must be trivially copyable");
+        
+        public:
+            using value_type             = T;
+            using size_type              = size_t;
+            using difference_type        = std::ptrdiff_t;
+            using pointer                = T *;
+            using const_pointer          = T const*;
+            using reference              = T &;
+            using const_reference        = T const&;
+            using iterator               = pointer;
+            using const_iterator         = const_pointer;
+            using reverse_iterator       = std::reverse_iterator<iterator>;
+            using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+            
+            // Expected access pattern, passed to madvise()
+            enum class advice { normal, sequential, random };
+            
+            mmap_vector() = default;
+            
+            // Anonymous mapping with size zeroed elements
+            explicit mmap_vector(size_t size) {
+                resize(size);
+            }
+            
+            // Maps the given file, then resizes it to size elements
+            mmap_vector(std::string const&path, size_t size);
+            
+            // Maps the given file, with as many elements as it contains.
+            // A trailing partial element is dropped.
+            explicit mmap_vector(std::string const&path);
+            
+            mmap_vector(mmap_vector const&) = delete;
+            mmap_vector &operator=(mmap_vector const&) = delete;
+            
+            mmap_vector(mmap_vector &&other) { swap(other); }
+            
+            mmap_vector &operator=(mmap_vector &&other) {
+                mmap_vector(std::move(other)).swap(*this);
+                return *this;
+            }
+            
+            ~mmap_vector();
+            
+            void swap(mmap_vector &other);
+            
+            pointer       data()       { return _data; }
+            const_pointer data() const { return _data; }
+            
+            size_t size() const { return _size; }
+            size_t capacity() const { return _capacity; }
+            bool empty() const { return _size == 0; }
+            
+            // Whether the elements are stored in a file
+            bool file_backed() const { return _fd != -1; }
+            
+            reference operator[](size_t i) {
+                assert(i < _size);
+                return _data[i];
+            }
+            
+            const_reference operator[](size_t i) const {
+                assert(i < _size);
+                return _data[i];
+            }
+            
+            iterator       begin()       { return _data; }
+            const_iterator begin() const { return _data; }
+            iterator       end()         { return _data + _size; }
+            const_iterator end()   const { return _data + _size; }
+            
+            const_iterator cbegin() const { return begin(); }
+            const_iterator cend()   const { return end(); }
+            
+            reverse_iterator rbegin() { return reverse_iterator(end()); }
+            reverse_iterator rend()   { return reverse_iterator(begin()); }
+            
+            const_reverse_iterator rbegin() const {
+                return const_reverse_iterator(end());
+            }
+            
+            const_reverse_iterator rend() const {
+                return const_reverse_iterator(begin());
+            }
+            
+            /*
+             * Changes the number of elements. New elements are zeroed.
+             * The capacity grows at least by half of its current value,
+             * rounded up to the growth granularity, so the mapping is
+             * rarely changed while resizing in small steps.
+             */
+            void resize(size_t size);
+            
+            // Ensures room for at least n elements
+            void reserve(size_t n);
+            
+            // Releases the capacity not used by the elements
+            void shrink_to_fit();
+            
+            /*
+             * Writes the modified pages back to the file with msync().
+             * If wait is false, the writes are only scheduled.
+             * Nothing is done for anonymous mappings.
+             */
+            void sync(bool wait = true);
+            
+            // Hints the kernel about the access pattern, also after remaps
+            void advise(advice a);
+        
+        private:
+            // Capacity grows in multiples of 2MB, the size of huge pages
+            static constexpr size_t granularity = size_t(2) << 20;
+            
+            static void check(bool ok, char const*what) {
+                if(!ok)
+                    throw std::system_error(errno, std::system_category(),
+                                            what);
+            }
+            
+            void open(std::string const&path);
+            void remap(size_t capacity);
+            void apply_advice();
+        
+        private:
+            T *_data = nullptr;
+            size_t _size = 0;
+            size_t _capacity = 0;
+            int _fd = -1;
+            advice _advice = advice::normal;
+        };
+        
+        // The delegation to the default constructor makes the destructor
+        // release the file if something fails later
+        template<typename T>
+        mmap_vector<T>::mmap_vector(std::string const&path, size_t size)
+            : mmap_vector()
+        {
+            open(path);
+            resize(size);
+        }
+        
+        template<typename T>
+        mmap_vector<T>::mmap_vector(std::string const&path)
+            : mmap_vector()
+        {
+            open(path);
+        }
+        
+        template<typename T>
+        mmap_vector<T>::~mmap_vector()
+        {
+            if(_data)
+                munmap(_data, _capacity * sizeof(T));
+            
+            if(_fd != -1) {
+                // Nothing better to do if this fails, in a destructor
+                int r = ftruncate(_fd, off_t(_size * sizeof(T)));
+                unused(r);
+                close(_fd);
+            }
+        }
+        
+        template<typename T>
+        void mmap_vector<T>::swap(mmap_vector &other)
+        {
+            using std::swap;
+            
+            swap(_data, other._data);
+            swap(_size, other._size);
+            swap(_capacity, other._capacity);
+            swap(_fd, other._fd);
+            swap(_advice, other._advice);
+        }
+        
+        template<typename T>
+        void mmap_vector<T>::open(std::string const&path)
+        {
+            _fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+            check(_fd != -1, "open");
+            
+            struct stat st;
+            check(fstat(_fd, &st) == 0, "fstat");
+            
+            size_t size = size_t(st.st_size) / sizeof(T);
+            
+            reserve(size);
+            _size = size;
+        }
+        
+        template<typename T>
+        void mmap_vector<T>::resize(size_t size)
+        {
+            if(size > _capacity) {
+                size_t grown = _capacity + _capacity / 2;
+                reserve(std::max(size, grown));
+            }
+            
+            // The tail of the mapping may hold stale elements
+            if(size > _size)
+                std::memset(static_cast<void *>(_data + _size), 0,
+                            (size - _size) * sizeof(T));
+            
+            _size = size;
+        }
+        
+        template<typename T>
+        void mmap_vector<T>::reserve(size_t n)
+        {
+            if(n <= _capacity)
+                return;
+            
+            size_t bytes = ceildiv(n * sizeof(T), granularity) * granularity;
+            
+            remap(bytes / sizeof(T));
+        }
+        
+        template<typename T>
+        void mmap_vector<T>::shrink_to_fit()
+        {
+            size_t page = size_t(sysconf(_SC_PAGESIZE));
+            size_t bytes = ceildiv(_size * sizeof(T), page) * page;
+            
+            if(bytes / sizeof(T) < _capacity)
+                remap(bytes / sizeof(T));
+        }
+        
+        /*
+         * Changes the capacity, resizing the file first, if any, so that
+         * the whole mapping is backed by it
+         */
+        template<typename T>
+        void mmap_vector<T>::remap(size_t capacity)
+        {
+            size_t old_bytes = _capacity * sizeof(T);
+            size_t new_bytes = capacity * sizeof(T);
+            
+            if(_fd != -1)
+                check(ftruncate(_fd, off_t(new_bytes)) == 0, "ftruncate");
+            
+            void *p = MAP_FAILED;
+            
+            if(new_bytes == 0) {
+                if(_data)
+                    munmap(_data, old_bytes);
+                p = nullptr;
+            } else if(_data == nullptr) {
+                int flags = _fd == -1 ? MAP_PRIVATE | MAP_ANONYMOUS
+                                      : MAP_SHARED;
+                p = mmap(nullptr, new_bytes, PROT_READ | PROT_WRITE,
+                         flags, _fd, 0);
+            } else {
+#if defined(__linux__)
+                p = mremap(_data, old_bytes, new_bytes, MREMAP_MAYMOVE);
+#else
+                // Without mremap(), anonymous mappings are copied
+                int flags = _fd == -1 ? MAP_PRIVATE | MAP_ANONYMOUS
+                                      : MAP_SHARED;
+                p = mmap(nullptr, new_bytes, PROT_READ | PROT_WRITE,
+                         flags, _fd, 0);
+                if(p != MAP_FAILED) {
+                    if(_fd == -1)
+                        std::memcpy(p, _data, std::min(old_bytes, new_bytes));
+                    munmap(_data, old_bytes);
+                }
+#endif
+            }
+            
+            check(p != MAP_FAILED, "mmap");
+            
+            _data = static_cast<T *>(p);
+            _capacity = capacity;
+            _size = std::min(_size, capacity);
+            
+            apply_advice();
+        }
+        
+        template<typename T>
+        void mmap_vector<T>::sync(bool wait)
+        {
+            if(_fd == -1 || _size == 0)
+                return;
+            
+            // msync() wants the address aligned to a page, as _data is
+            check(msync(_data, _size * sizeof(T),
+                        wait ? MS_SYNC : MS_ASYNC) == 0, "msync");
+        }
+        
+        template<typename T>
+        void mmap_vector<T>::advise(advice a)
+        {
+            _advice = a;
+            apply_advice();
+        }
+        
+        template<typename T>
+        void mmap_vector<T>::apply_advice()
+        {
+            if(_data == nullptr)
+                return;
+            
+            int flags[] = { MADV_NORMAL, MADV_SEQUENTIAL, MADV_RANDOM };
+            
+            check(madvise(_data, _capacity * sizeof(T),
+                          flags[int(_advice)]) == 0, "madvise");
+        }
+    
+    } // namespace internal
+    
+    // Public things
+    using internal::mmap_vector;
+} // namespace bv
+
+#endif
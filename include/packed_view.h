@@ -19,23 +19,107 @@
 
 #include "bitview.h"
 #include "internal/bits.h"
+#include "internal/simd.h"
 #include "internal/view_reference.h"
 
+#include <array>
 #include <string>
+#include <cstring>
+#include <vector>
 
 namespace bv
 {
     namespace internal {
-        template<template<typename ...> class Container>
-        class packed_view
+        // Returns a word with a set bit at the beginning of each of the
+        // fields of the given width that fit in a word
+        template<typename T>
+        constexpr T compute_field_mask(size_t width,
+                                       size_t fields = 0, T mask = 0)
         {
-            static constexpr size_t W = bitview<Container>::W;
+            return width == 0 ? 0
+                 : fields == bitsize<T>() / width ? mask
+                 : compute_field_mask<T>(width, fields + 1,
+                                         T((fields == 0 ? 0 : mask << width) | 1));
+        }
+        
+        /*
+         * Storage of the width of the fields of a packed_view.
+         * If Width is zero the width is chosen at runtime, otherwise it's
+         * fixed at compile-time, and the empty class takes no space at all.
+         */
+        template<size_t Width, typename Word>
+        class packed_width
+        {
+        public:
+            using word_type = Word;
+            
+            static constexpr size_t width() { return Width; }
+            
+            static constexpr word_type field_mask() {
+                return compute_field_mask<word_type>(Width);
+            }
+        
+        protected:
+            packed_width() = default;
+            
+            explicit packed_width(size_t width) {
+                assert(width == Width && "Wrong width for a packed_array");
+                unused(width);
+            }
+            
+            void set_width(size_t width) {
+                assert(width == Width && "Wrong width for a packed_array");
+                unused(width);
+            }
+        };
+        
+        template<typename Word>
+        class packed_width<0, Word>
+        {
+        public:
+            using word_type = Word;
+            
+            size_t width() const { return _width; }
+            
+            word_type field_mask() const { return _field_mask; }
+        
+        protected:
+            packed_width() = default;
+            
+            explicit packed_width(size_t width)
+                : _width(width),
+                  _field_mask(compute_field_mask<word_type>(width)) { }
+            
+            void set_width(size_t width) {
+                if(width != _width) {
+                    _width = width;
+                    _field_mask = compute_field_mask<word_type>(width);
+                }
+            }
+        
+        private:
+            // Number of bits per field
+            size_t _width = 0;
+            
+            // Mask with a set bit at the beginning of each field
+            word_type _field_mask = 0;
+        };
+        
+        template<template<typename ...> class Container, size_t Width = 0,
+                 typename Word = uint64_t>
+        class packed_view : private packed_width<Width, Word>
+        {
+            static constexpr size_t W = bitview<Container, Word>::W;
+            
+            static_assert(Width <= W, "Fields can't be wider than a word");
+            
+            using width_base = packed_width<Width, Word>;
             
             template<bool IsConst>
             class packed_iterator;
             
         public:
-            using word_type  = typename bitview<Container>::word_type;
+            using word_type  = typename bitview<Container, Word>::word_type;
             using value_type = word_type;
             
             using range_reference        = internal::range_reference<packed_view>;
@@ -50,13 +134,49 @@ namespace bv
             using reverse_iterator       = std::reverse_iterator<iterator>;
             using reverse_const_iterator = std::reverse_iterator<const_iterator>;
             
-            using container_type = typename bitview<Container>::container_type;
+            using container_type =
+                typename bitview<Container, Word>::container_type;
+            
+            /*
+             * What to do when the result of an arithmetic operation on a
+             * field doesn't fit into it:
+             * - may_overflow: the result wraps around, modulo 2^width()
+             * - cant_overflow: the result is guaranteed to fit by the caller,
+             *                  which is asserted in debug builds
+             * - saturate: the result is clamped to the maximum value or zero
+             * Bulk operations support only the first two.
+             */
+            enum overflow_opt {
+                may_overflow,
+                cant_overflow,
+                saturate
+            };
             
             packed_view() = default;
             
             packed_view(size_t width, size_t size)
-                : _bits(width * size), _size(size), _width(width),
-                  _field_mask(compute_field_mask(width)) { }
+                : width_base(width), _bits(width * size), _size(size) { }
+            
+            // Only for packed_array, where the width is known
+            template<size_t Wd = Width, REQUIRES(Wd != 0)>
+            explicit packed_view(size_t size)
+                : _bits(Width * size), _size(size) { }
+            
+            /*
+             * Presents 'size' fields of the given width stored in an existing
+             * container, e.g. a buffer_view over external memory, which must
+             * be large enough to hold them
+             */
+            packed_view(size_t width, size_t size, container_type container)
+                : width_base(width), _bits(std::move(container)), _size(size)
+            {
+                assert(width * size <= _bits.size() &&
+                       "Container too small for the packed_view");
+            }
+            
+            template<size_t Wd = Width, REQUIRES(Wd != 0)>
+            packed_view(size_t size, container_type container)
+                : packed_view(Width, size, std::move(container)) { }
             
             packed_view(packed_view const&) = default;
             packed_view(packed_view &&) = default;
@@ -66,11 +186,11 @@ namespace bv
             container_type const&container() const { return _bits.container(); }
             container_type      &container()       { return _bits.container(); }
             
-            bitview<Container> const&bits() const { return _bits; }
-            bitview<Container>      &bits()       { return _bits; }
+            bitview<Container, Word> const&bits() const { return _bits; }
+            bitview<Container, Word>      &bits()       { return _bits; }
             
             // A default initialized packed_view is empty
-            bool empty() const { return _bits.empty() || _width == 0; }
+            bool empty() const { return _bits.empty() || width() == 0; }
             
             // The number of fields presented by the packed_view
             size_t size() const {
@@ -79,14 +199,14 @@ namespace bv
             
             // The number of fields that can fit in the underlying bitview
             size_t capacity() const {
-                return empty() ? 0 : _bits.size() / _width;
+                return empty() ? 0 : _bits.size() / width();
             }
             
             // The number of bits for each field
-            size_t width() const { return _width; }
+            size_t width() const { return width_base::width(); }
             
-            word_type field_mask() const { return _field_mask; }
-            word_type flag_mask() const { return _field_mask << (_width - 1); }
+            word_type field_mask() const { return width_base::field_mask(); }
+            word_type flag_mask() const { return field_mask() << (width() - 1); }
             
             /*
              * Change the size of the view, possibly changing the size of the
@@ -94,7 +214,7 @@ namespace bv
              */
             void resize(size_t size) {
                 _size = size;
-                _bits.resize(_width * size);
+                _bits.resize(width() * size);
             }
             
             /*
@@ -105,10 +225,7 @@ namespace bv
             void reset(size_t width, size_t size) {
                 assert(size == 0 || width != 0);
                 
-                if(width != _width) {
-                    _width = width;
-                    _field_mask = compute_field_mask(width);
-                }
+                width_base::set_width(width);
                 resize(size);
             }
             
@@ -127,8 +244,88 @@ namespace bv
             void increment(size_t begin, size_t end, size_t n);
             void decrement(size_t begin, size_t end, size_t n);
             
-            template<template<typename ...> class C>
-            void copy(packed_view<C> const&src,
+            /*
+             * Element-wise sum and difference with the fields of a range of
+             * another packed_view of the same width. Like for increment() and
+             * decrement(), the fields must not overflow. Ranges are handled
+             * like in copy(), and they must not overlap unless they are the
+             * same range.
+             */
+            template<template<typename ...> class C, size_t Wd>
+            void add(packed_view<C, Wd, Word> const&src,
+                     size_t src_begin, size_t src_end,
+                     size_t dest_begin, size_t dest_end);
+            
+            template<template<typename ...> class C, size_t Wd>
+            void subtract(packed_view<C, Wd, Word> const&src,
+                          size_t src_begin, size_t src_end,
+                          size_t dest_begin, size_t dest_end);
+            
+            /*
+             * Replaces each field in [begin, end) with the sum of the fields
+             * of the range up to itself. The sums must fit into the fields.
+             */
+            void prefix_sum(size_t begin, size_t end);
+            
+            /*
+             * Search functions over the fields in the range [begin, end).
+             * They compare many fields at once with broadword operations.
+             *
+             * - find() returns the index of the first field equal to value,
+             *   or end if there's none
+             * - count_less() returns the number of fields less than value
+             * - lower_bound() returns the index of the first field not less
+             *   than value, or end if there's none. The range must be sorted.
+             */
+            size_t find(size_t begin, size_t end, word_type value) const;
+            size_t count_less(size_t begin, size_t end, word_type value) const;
+            size_t lower_bound(size_t begin, size_t end, word_type value) const;
+            
+            /*
+             * Bulk conversion between fields and arrays of native integers.
+             * unpack() stores the fields in [begin, end) into out, while
+             * pack() stores the n integers of in into the fields starting at
+             * dest_begin. T must be an unsigned type wide enough for a field.
+             */
+            template<typename T>
+            void unpack(size_t begin, size_t end, T *out) const;
+            
+            template<typename T>
+            void pack(T const*in, size_t n, size_t dest_begin);
+            
+            /*
+             * Changes the width of the fields, preserving their values, which
+             * must fit into the new width. The fields are moved in place a
+             * chunk at a time with unpack() and pack(), or with BMI2 a few
+             * fields per instruction, from the end when growing, so they
+             * never overwrite fields not yet moved. Growing first resizes the
+             * container, whose allocation of zeroed memory can cost more than
+             * moving the fields. Only for views with a width chosen at runtime.
+             */
+            template<size_t Wd = Width, REQUIRES(Wd == 0)>
+            void repack(size_t width);
+            
+            /*
+             * Sorts the fields in [begin, end) in ascending order, with a LSD
+             * radix sort of the unpacked fields. It's much faster than
+             * std::sort() through the proxy iterators.
+             */
+            void sort(size_t begin, size_t end);
+            
+            /*
+             * Batched access to the fields in [begin, end), which are unpacked
+             * a chunk at a time. for_each() calls f with the value of each
+             * field, while transform() replaces each field with the value
+             * returned by f, which must fit into the field.
+             */
+            template<typename F>
+            void for_each(size_t begin, size_t end, F f) const;
+            
+            template<typename F>
+            void transform(size_t begin, size_t end, F f);
+            
+            template<template<typename ...> class C, size_t Wd>
+            void copy(packed_view<C, Wd, Word> const&src,
                       size_t src_begin, size_t src_end,
                       size_t dest_begin, size_t dest_end);
             
@@ -184,62 +381,92 @@ namespace bv
             /*
              * Private details
              */
-            static word_type compute_field_mask(size_t width);
+            void add_pattern(size_t begin, size_t end, word_type n,
+                             bool subtract, overflow_opt opt);
             
-            enum overflow_opt {
-                may_overflow,
-                cant_overflow
-            };
+            void add_pattern_bits(size_t begin, size_t end, word_type n,
+                                  bool subtract, overflow_opt opt);
             
-            void increment(size_t begin, size_t end, size_t n, overflow_opt opt);
-            size_t find(size_t begin, size_t end, word_type value) const;
+            template<template<typename ...> class C, size_t Wd>
+            void add_range(packed_view<C, Wd, Word> const&src,
+                           size_t src_begin, size_t src_end,
+                           size_t dest_begin, size_t dest_end,
+                           bool subtract);
+            
+            template<template<typename ...> class C, size_t Wd>
+            void add_range_bits(packed_view<C, Wd, Word> const&src,
+                                size_t src_begin,
+                                size_t begin, size_t end, bool subtract);
             
+            template<typename F>
+            void accumulate(size_t begin, size_t end, F addend,
+                            bool subtract, overflow_opt opt);
+            
+            template<typename T>
+            void radix_sort(size_t begin, size_t end);
+            
+            // unpack() and pack() of n fields of the given width starting
+            // at the bit p, which may differ from width() while repacking
+            template<typename T>
+            void unpack_bits(size_t p, size_t width, size_t n, T *out) const;
+            
+            template<typename T>
+            void pack_bits(T const*in, size_t n, size_t p, size_t width);
+            
+            template<typename T>
+            void repack_fields(size_t width);
+
+#if defined(__BMI2__)
+            void repack_lanes(size_t width);
+#endif
+            
+            // Number of fields unpacked at once by for_each() and transform()
+            static constexpr size_t chunk_size = 256;
+        
         private:
             // Actual data
-            bitview<Container> _bits;
+            bitview<Container, Word> _bits;
             
             // Number of requested fields
             size_t _size = 0;
-            
-            // Number of bits per field
-            size_t _width = 0;
-            
-            // Mask with a set bit at the beginning of each field
-            word_type _field_mask = 0;
         };
         
-        template<template<typename ...> class C>
-        typename packed_view<C>::word_type
-        packed_view<C>::compute_field_mask(size_t width)
-        {
-            size_t fields_per_word = W / width;
-            word_type mask = 0;
-            
-            for(size_t i = 0; i < fields_per_word; ++i)
-            {
-                mask = mask << width;
-                mask = mask | 1;
-            }
-            
-            return mask;
-        }
+        /*
+         * A packed_view with fields of a width fixed at compile-time
+         */
+        template<size_t Width, template<typename ...> class Container,
+                 typename Word = uint64_t>
+        using packed_array = packed_view<Container, Width, Word>;
         
-        template<template<typename ...> class C>
-        typename packed_view<C>::word_type
-        packed_view<C>::get(size_t begin, size_t end) const
+        template<template<typename ...> class C, size_t Wd, typename Word>
+        typename packed_view<C, Wd, Word>::word_type
+        packed_view<C, Wd, Word>::get(size_t begin, size_t end) const
         {
             return _bits.get(begin * width(), end * width());
         }
         
-        template<template<typename ...> class C>
-        typename packed_view<C>::value_type
-        packed_view<C>::get(size_t index) const
+        /*
+         * Fields of power of two width never straddle words, so they are
+         * accessed directly. With a width fixed at compile-time the check
+         * and the arithmetic here are folded into constants.
+         */
+        template<template<typename ...> class C, size_t Wd, typename Word>
+        typename packed_view<C, Wd, Word>::value_type
+        packed_view<C, Wd, Word>::get(size_t index) const
         {
+            if((width() & (width() - 1)) == 0) {
+                size_t p = index * width();
+                
+                return lowbits(container()[p / W] >> (p % W), width());
+            }
+            
             return get(index, index + 1);
         }
         
-        template<template<typename ...> class C>
-        void packed_view<C>::set(size_t begin, size_t end, word_type pattern)
+        template<template<typename ...> class C, size_t Wd, typename Word>
+        void
+        packed_view<C, Wd, Word>::set(size_t begin, size_t end,
+                                      word_type pattern)
         {
             size_t fields_per_word = W / width();
             size_t bits_per_word = fields_per_word * width(); // It's not useless
@@ -260,73 +487,750 @@ namespace bv
             }
         }
         
-        template<template<typename ...> class C>
-        void packed_view<C>::set(size_t index, value_type value)
+        template<template<typename ...> class C, size_t Wd, typename Word>
+        void packed_view<C, Wd, Word>::set(size_t index, value_type value)
         {
+            if((width() & (width() - 1)) == 0) {
+                size_t p = index * width();
+                
+                ensure_bitsize(value, width());
+                set_bitfield(container()[p / W], p % W, p % W + width(), value);
+                return;
+            }
+            
             _bits.set(index * width(), (index + 1) * width(), value);
         }
         
-        template<template<typename ...> class C>
-        void packed_view<C>::increment(size_t begin, size_t end,
-                                       size_t n, overflow_opt opt)
+        /*
+         * Adds to (or subtracts from) the bits in the range [begin, end) of
+         * the underlying bitview a multiword number, propagating the carries
+         * between words. The number is produced a word at a time by calling
+         * addend(lo, hi) for each word spanned by the range, in order, which
+         * returns the next bits of the number placed in the [lo, hi) bits of
+         * the word. When the fields don't overflow, no carry crosses the
+         * boundary of a field, so this is the same as doing the sum field by
+         * field, but with only a couple of operations for each word.
+         */
+        template<template<typename ...> class C, size_t Wd, typename Word>
+        template<typename F>
+        void
+        packed_view<C, Wd, Word>::accumulate(size_t begin, size_t end, F addend,
+                                             bool subtract, overflow_opt opt)
+        {
+            if(is_empty_range(begin, end))
+                return;
+            
+            container_type &words = container();
+            
+            size_t first = begin / W;
+            size_t last  = (end - 1) / W;
+            size_t hend  = end - last * W;
+            
+            word_type high = highbits(words[last], W - hend);
+            
+            word_type carry = 0;
+            for(size_t i = first; i <= last; ++i)
+            {
+                size_t lo = i == first ? begin % W : 0;
+                size_t hi = i == last  ? hend      : W;
+                
+                word_type a = addend(lo, hi);
+                word_type w = words[i];
+                word_type r;
+                
+                if(!subtract) {
+                    r = w + a;
+                    word_type c = r < a;
+                    r += carry;
+                    carry = c | (r < carry);
+                } else {
+                    word_type d = w - a;
+                    word_type c = w < a;
+                    r = d - carry;
+                    carry = c | (d < carry);
+                }
+                
+                words[i] = r;
+            }
+            
+            // Nothing has to leak out of the range
+            assert(opt == may_overflow ||
+                   (carry == 0 && highbits(words[last], W - hend) == high));
+            unused(high, opt);
+        }
+        
+        /*
+         * The number added to the bits of the range has n at the beginning
+         * of every field. In the first word, the fields begin at the start
+         * of the range, and from a word to the next the position of the
+         * first field moves back by W % width() bits, while the high bits of
+         * the last field spill over the next word.
+         */
+        template<template<typename ...> class C, size_t Wd, typename Word>
+        void
+        packed_view<C, Wd, Word>::add_pattern_bits(size_t begin, size_t end,
+                                                   word_type n, bool subtract,
+                                                   overflow_opt opt)
+        {
+            const size_t r = W % width();
+            
+            // Bit set at the beginning of each field that starts in a word
+            const word_type starts = field_mask() |
+                                     (r == 0 ? 0 : word_type(1) << (W - r));
+            
+            size_t phase = begin % W;
+            word_type spill = 0;
+            
+            auto addend = [&](size_t, size_t hi) {
+                word_type a = (n * lowbits(starts << phase, hi)) | spill;
+                
+                size_t m = phase < width() ? phase : phase % width();
+                phase = m >= r ? m - r : m + width() - r;
+                spill = phase == 0 ? 0 : n >> (width() - phase);
+                
+                return a;
+            };
+            
+            accumulate(begin, end, addend, subtract, opt);
+        }
+        
+        /*
+         * If fields never straddle words, all the whole words of the range
+         * get the same pattern and no carries, so they're updated by the
+         * vectorizable add_words() if the storage is contiguous.
+         */
+        template<template<typename ...> class C, size_t Wd, typename Word>
+        void packed_view<C, Wd, Word>::add_pattern(size_t begin, size_t end,
+                                                   word_type n, bool subtract,
+                                                   overflow_opt opt)
+        {
+            if(is_empty_range(begin, end))
+                return;
+            
+            ensure_bitsize(n, width());
+            
+            size_t b = begin * width();
+            size_t e = end   * width();
+            
+            size_t body_begin = ceildiv(b, W);
+            size_t body_end   = e / W;
+            
+            word_type *data = _bits.data();
+            if(data != nullptr && W % width() == 0 && body_begin < body_end)
+            {
+                word_type pattern = field_mask() * n;
+                
+                add_pattern_bits(b, body_begin * W, n, subtract, opt);
+                
+                if(subtract)
+                    sub_words(data + body_begin, pattern, body_end - body_begin);
+                else
+                    add_words(data + body_begin, pattern, body_end - body_begin);
+                
+                add_pattern_bits(body_end * W, e, n, subtract, opt);
+            } else {
+                add_pattern_bits(b, e, n, subtract, opt);
+            }
+        }
+        
+        template<template<typename ...> class C, size_t Wd, typename Word>
+        void
+        packed_view<C, Wd, Word>::increment(size_t begin, size_t end, size_t n)
+        {
+            add_pattern(begin, end, n, false, cant_overflow);
+        }
+        
+        template<template<typename ...> class C, size_t Wd, typename Word>
+        void
+        packed_view<C, Wd, Word>::decrement(size_t begin, size_t end, size_t n)
+        {
+            add_pattern(begin, end, n, true, cant_overflow);
+        }
+        
+        template<template<typename ...> class C1, size_t Wd1, typename Word>
+        template<template<typename ...> class C2, size_t Wd2>
+        void
+        packed_view<C1, Wd1, Word>::add_range_bits(packed_view<C2, Wd2, Word> const&src,
+                                                   size_t src_begin,
+                                                   size_t begin, size_t end,
+                                                   bool subtract)
+        {
+            auto addend = [&](size_t lo, size_t hi) {
+                word_type a = src.bits().get(src_begin, src_begin + hi - lo);
+                src_begin += hi - lo;
+                
+                return a << lo;
+            };
+            
+            accumulate(begin, end, addend, subtract, cant_overflow);
+        }
+        
+        /*
+         * As for add_pattern(), if fields never straddle words and the two
+         * ranges are equally aligned, the whole words are simply summed.
+         */
+        template<template<typename ...> class C1, size_t Wd1, typename Word>
+        template<template<typename ...> class C2, size_t Wd2>
+        void
+        packed_view<C1, Wd1, Word>::add_range(packed_view<C2, Wd2, Word> const&src,
+                                              size_t src_begin, size_t src_end,
+                                              size_t dest_begin, size_t dest_end,
+                                              bool subtract)
+        {
+            assert(src.width() == width());
+            
+            size_t len = std::min(src_end - src_begin, dest_end - dest_begin);
+            if(is_empty_range(0, len))
+                return;
+            
+            size_t sb = src_begin  * width();
+            size_t b  = dest_begin * width();
+            size_t e  = b + len * width();
+            
+            size_t body_begin = ceildiv(b, W);
+            size_t body_end   = e / W;
+            
+            word_type       *data = _bits.data();
+            word_type const*sdata = src.bits().data();
+            if(data != nullptr && sdata != nullptr && W % width() == 0 &&
+               sb % W == b % W && body_begin < body_end)
+            {
+                size_t head = body_begin * W - b;
+                size_t tail = body_end   * W - b;
+                size_t n    = body_end - body_begin;
+                
+                add_range_bits(src, sb, b, body_begin * W, subtract);
+                
+                if(subtract)
+                    sub_words(data + body_begin, sdata + (sb + head) / W, n);
+                else
+                    add_words(data + body_begin, sdata + (sb + head) / W, n);
+                
+                add_range_bits(src, sb + tail, body_end * W, e, subtract);
+            } else {
+                add_range_bits(src, sb, b, e, subtract);
+            }
+        }
+        
+        template<template<typename ...> class C1, size_t Wd1, typename Word>
+        template<template<typename ...> class C2, size_t Wd2>
+        void
+        packed_view<C1, Wd1, Word>::add(packed_view<C2, Wd2, Word> const&src,
+                                        size_t src_begin, size_t src_end,
+                                        size_t dest_begin, size_t dest_end)
+        {
+            add_range(src, src_begin, src_end, dest_begin, dest_end, false);
+        }
+        
+        template<template<typename ...> class C1, size_t Wd1, typename Word>
+        template<template<typename ...> class C2, size_t Wd2>
+        void
+        packed_view<C1, Wd1, Word>::subtract(packed_view<C2, Wd2, Word> const&src,
+                                             size_t src_begin, size_t src_end,
+                                             size_t dest_begin, size_t dest_end)
+        {
+            add_range(src, src_begin, src_end, dest_begin, dest_end, true);
+        }
+        
+        /*
+         * The prefix sum inside a word is done with log(fields_per_word)
+         * shifts and sums, then the total of the previous words is added
+         */
+        template<template<typename ...> class C, size_t Wd, typename Word>
+        void packed_view<C, Wd, Word>::prefix_sum(size_t begin, size_t end)
         {
             size_t fields_per_word = W / width();
             size_t bits_per_word = fields_per_word * width(); // It's not useless
             size_t len = (end - begin) * width();
             size_t rem = len % bits_per_word;
             
+            word_type total = 0;
             for(size_t step, p = begin * width();
                 p < end * width();
                 len -= step, p += step)
             {
                 step = len < bits_per_word ? rem : bits_per_word;
                 
-                word_type result = _bits.get(p, p + step) +
-                lowbits(field_mask() * n, step);
+                word_type word = _bits.get(p, p + step);
+                for(size_t shift = width(); shift < step; shift *= 2)
+                    word += word << shift;
+                
+                word = lowbits(word + field_mask() * total, step);
                 
-                if(opt == cant_overflow)
-                    ensure_bitsize(result, step);
+                _bits.set(p, p + step, word);
                 
-                _bits.set(p, p + step, lowbits(result, step));
+                total = word >> (step - width());
             }
         }
         
-        template<template<typename ...> class C>
-        void packed_view<C>::increment(size_t begin, size_t end, size_t n)
+        template<template<typename ...> class C, size_t Wd, typename Word>
+        size_t packed_view<C, Wd, Word>::find(size_t begin, size_t end,
+                                              word_type value) const
         {
-            increment(begin, end, n, cant_overflow);
+            size_t fields_per_word = W / width();
+            size_t bits_per_word = fields_per_word * width(); // It's not useless
+            size_t len = (end - begin) * width();
+            size_t rem = len % bits_per_word;
+            
+            ensure_bitsize(value, width());
+            
+            const word_type pattern = field_mask() * value;
+            const word_type flags = flag_mask();
+            
+            for(size_t step, p = begin * width();
+                p < end * width();
+                len -= step, p += step)
+            {
+                step = len < bits_per_word ? rem : bits_per_word;
+                
+                word_type eq = lowbits(fields_equal(_bits.get(p, p + step),
+                                                    pattern, flags), step);
+                if(eq != 0)
+                    return (p + trailing_zeros(eq)) / width();
+            }
+            
+            return end;
         }
+        
+        template<template<typename ...> class C, size_t Wd, typename Word>
+        size_t packed_view<C, Wd, Word>::count_less(size_t begin, size_t end,
+                                                    word_type value) const
+        {
+            size_t fields_per_word = W / width();
+            size_t bits_per_word = fields_per_word * width(); // It's not useless
+            size_t len = (end - begin) * width();
+            size_t rem = len % bits_per_word;
+            
+            ensure_bitsize(value, width());
+            
+            const word_type pattern = field_mask() * value;
+            const word_type flags = flag_mask();
+            
+            size_t count = end - begin;
+            for(size_t step, p = begin * width();
+                p < end * width();
+                len -= step, p += step)
+            {
+                step = len < bits_per_word ? rem : bits_per_word;
+                
+                word_type ge = fields_greater_equal(_bits.get(p, p + step),
+                                                    pattern, flags);
+                count -= popcount(lowbits(ge, step));
+            }
+            
+            return count;
+        }
+        
+        /*
+         * Binary search on blocks of fields as large as a word,
+         * followed by a broadword search inside the block that was found
+         */
+        template<template<typename ...> class C, size_t Wd, typename Word>
+        size_t packed_view<C, Wd, Word>::lower_bound(size_t begin, size_t end,
+                                                     word_type value) const
+        {
+            if(is_empty_range(begin, end))
+                return end;
+            
+            const size_t fields_per_word = W / width();
+            
+            size_t lo = 0;
+            size_t hi = ceildiv(end - begin, fields_per_word);
+            while(lo < hi) {
+                size_t mid = lo + (hi - lo) / 2;
+                size_t last = std::min(begin + (mid + 1) * fields_per_word, end) - 1;
+                
+                if(get(last) < value)
+                    lo = mid + 1;
+                else
+                    hi = mid;
+            }
+            
+            size_t block_begin = begin + lo * fields_per_word;
+            if(block_begin >= end)
+                return end;
+            
+            size_t block_end = std::min(block_begin + fields_per_word, end);
+            
+            return block_begin + count_less(block_begin, block_end, value);
+        }
+        
+        template<template<typename ...> class C, size_t Wd, typename Word>
+        template<typename T>
+        void
+        packed_view<C, Wd, Word>::unpack(size_t begin, size_t end, T *out) const
+        {
+            static_assert(is_integer<T>::value && !std::is_signed<T>::value,
+                          "unpack() needs an unsigned integer type");
+            assert(width() <= bitsize<T>());
+            
+            if(is_empty_range(begin, end))
+                return;
+            
+            unpack_bits(begin * width(), width(), end - begin, out);
+        }
+        
+        template<template<typename ...> class C, size_t Wd, typename Word>
+        template<typename T>
+        void
+        packed_view<C, Wd, Word>::pack(T const*in, size_t n, size_t dest_begin)
+        {
+            static_assert(is_integer<T>::value && !std::is_signed<T>::value,
+                          "pack() needs an unsigned integer type");
+            
+            if(n == 0)
+                return;
+            
+            check_valid_range(dest_begin, dest_begin + n, capacity());
+            
+            pack_bits(in, n, dest_begin * width(), width());
+        }
+        
+        /*
+         * Fields are read sequentially with a bit_reader. If supported, the
+         * bulk is extracted by the AVX2 gathers of unpack_fields() or, for
+         * uint32_t, two fields at a time by spreading them with BMI2 pdep.
+         */
+        template<template<typename ...> class C, size_t Wd, typename Word>
+        template<typename T>
+        void packed_view<C, Wd, Word>::unpack_bits(size_t p, size_t width,
+                                                   size_t n, T *out) const
+        {
+            // Full-word fields don't need any shifting
+            if(width == W) {
+                for(size_t i = 0; i < n; ++i)
+                    out[i] = T(container()[p / W + i]);
+                return;
+            }
+            
+            word_type const*data = _bits.data();
+            size_t i = data == nullptr ? 0 :
+                       unpack_fields(data, container().size(),
+                                     p, width, out, n);
+            
+            bit_reader<container_type> reader(container(), p + i * width);
+
+#if defined(__BMI2__)
+            if(sizeof(T) == 4 && W == 64 && 2 * width < W) {
+                const uint64_t lanes = lowbits(~uint64_t(0), width) *
+                                       ((uint64_t(1) << 32) | 1);
+                for(; i + 2 <= n; i += 2) {
+                    uint64_t pair = deposit_bits(
+                                        uint64_t(reader.read(2 * width)),
+                                        lanes);
+                    std::memcpy(out + i, &pair, sizeof(pair));
+                }
+            }
+#endif
 
-        template<template<typename ...> class C>
-        void packed_view<C>::decrement(size_t begin, size_t end, size_t n)
+            for(; i < n; ++i)
+                out[i] = T(reader.read(width));
+        }
+        
+        template<template<typename ...> class C, size_t Wd, typename Word>
+        template<typename T>
+        void packed_view<C, Wd, Word>::pack_bits(T const*in, size_t n,
+                                                 size_t p, size_t width)
+        {
+            if(width == W) {
+                for(size_t i = 0; i < n; ++i)
+                    container()[p / W + i] = word_type(in[i]);
+                return;
+            }
+            
+            bit_writer<container_type> writer(container(), p);
+            
+            size_t i = 0;
+#if defined(__BMI2__)
+            if(sizeof(T) == 4 && W == 64 && 2 * width < W) {
+                const uint64_t lanes = lowbits(~uint64_t(0), width) *
+                                       ((uint64_t(1) << 32) | 1);
+                for(; i + 2 <= n; i += 2) {
+                    uint64_t pair;
+                    std::memcpy(&pair, in + i, sizeof(pair));
+                    writer.write(word_type(extract_bits(pair, lanes)),
+                                 2 * width);
+                }
+            }
+#endif
+
+            for(; i < n; ++i)
+                writer.write(in[i], width);
+            
+            writer.flush();
+        }
+        
+        template<template<typename ...> class C, size_t Wd, typename Word>
+        template<size_t, typename>
+        void packed_view<C, Wd, Word>::repack(size_t width)
+        {
+            assert(width != 0 && width <= W);
+            
+            if(std::max(width, this->width()) <= 32)
+                repack_fields<uint32_t>(width);
+            else if(std::max(width, this->width()) <= 64)
+                repack_fields<uint64_t>(width);
+            else
+                repack_fields<word_type>(width);
+        }
+        
+        /*
+         * The i-th field moves from the bit i * old to the bit i * width.
+         * When growing, a chunk is written over the old fields that follow
+         * it, which have already been moved going from the end, and when
+         * shrinking over the ones that precede it, already moved going from
+         * the beginning.
+         */
+        template<template<typename ...> class C, size_t Wd, typename Word>
+        template<typename T>
+        void packed_view<C, Wd, Word>::repack_fields(size_t width)
+        {
+            const size_t old = this->width();
+            const size_t n = _size;
+            
+            if(width == old || n == 0) {
+                width_base::set_width(width);
+                return;
+            }
+
+#if defined(__BMI2__)
+            if(W == 64 && 2 * std::max(width, old) < W) {
+                repack_lanes(width);
+                return;
+            }
+#endif
+            
+            T buffer[chunk_size];
+            
+            if(width > old) {
+                _bits.resize(width * n);
+                
+                for(size_t e = n; e > 0;) {
+                    size_t b = e - std::min(e, size_t(chunk_size));
+                    
+                    unpack_bits(b * old, old, e - b, buffer);
+                    pack_bits(buffer, e - b, b * width, width);
+                    e = b;
+                }
+            } else {
+                for(size_t b = 0; b < n; b += chunk_size) {
+                    size_t e = std::min(n, b + size_t(chunk_size));
+                    
+                    unpack_bits(b * old, old, e - b, buffer);
+                    pack_bits(buffer, e - b, b * width, width);
+                }
+                
+                _bits.resize(width * n);
+            }
+            
+            width_base::set_width(width);
+        }
+        
+#if defined(__BMI2__)
+        /*
+         * Moves k fields at a time, as many as fit in a word with the wider
+         * width, spreading them into the lanes of the new width with a BMI2
+         * pdep when growing, or compacting them with a pext when shrinking.
+         * Shrinking streams over the whole view, since the writes never
+         * pass the reads. Growing goes a chunk at a time from the end, as
+         * in repack_fields(), reading each chunk from a copy of its words,
+         * since its first fields are written over its last ones. Chunks
+         * begin at multiples of chunk_size, so both copies begin on a word.
+         */
+        template<template<typename ...> class C, size_t Wd, typename Word>
+        void packed_view<C, Wd, Word>::repack_lanes(size_t width)
+        {
+            const size_t old = this->width();
+            const size_t n = _size;
+            const size_t wide = std::max(old, width);
+            const size_t k = (W - 1) / wide;
+            
+            const word_type field = lowbits(~word_type(0), std::min(old, width));
+            word_type lanes = 0;
+            for(size_t j = 0; j < k; ++j)
+                lanes |= field << (j * wide);
+            
+            if(width < old) {
+                bit_reader<container_type> reader(container(), 0);
+                bit_writer<container_type> writer(container(), 0);
+                
+                size_t i = 0;
+                for(; i + k <= n; i += k)
+                    writer.write(word_type(extract_bits(reader.read(k * old),
+                                                        lanes)),
+                                 k * width);
+                for(; i < n; ++i)
+                    writer.write(reader.read(old), width);
+                
+                writer.flush();
+                _bits.resize(width * n);
+                width_base::set_width(width);
+                return;
+            }
+            
+            _bits.resize(width * n);
+            
+            // The old fields are narrower than half a word
+            std::array<word_type, chunk_size / 2 + 1> copy;
+            
+            for(size_t e = n; e > 0;) {
+                size_t b = (e - 1) / chunk_size * chunk_size;
+                
+                size_t first = b * old / W;
+                for(size_t j = 0; j < ceildiv((e - b) * old, W); ++j)
+                    copy[j] = container()[first + j];
+                
+                bit_reader<decltype(copy)> reader(copy, 0);
+                bit_writer<container_type> writer(container(), b * width);
+                
+                size_t i = b;
+                for(; i + k <= e; i += k)
+                    writer.write(word_type(deposit_bits(reader.read(k * old),
+                                                        lanes)),
+                                 k * width);
+                for(; i < e; ++i)
+                    writer.write(reader.read(old), width);
+                
+                writer.flush();
+                e = b;
+            }
+            
+            width_base::set_width(width);
+        }
+#endif
+
+        template<template<typename ...> class C, size_t Wd, typename Word>
+        void packed_view<C, Wd, Word>::sort(size_t begin, size_t end)
+        {
+            if(width() <= 32)
+                radix_sort<uint32_t>(begin, end);
+            else if(width() <= 64)
+                radix_sort<uint64_t>(begin, end);
+            else
+                radix_sort<word_type>(begin, end);
+        }
+        
+        /*
+         * Fields are sorted by digits of at most 11 bits, so for example
+         * 20 bits fields take two passes. The histograms of all the digits
+         * are computed in a single scan, and a pass is skipped if all the
+         * fields have the same digit.
+         */
+        template<template<typename ...> class C, size_t Wd, typename Word>
+        template<typename T>
+        void packed_view<C, Wd, Word>::radix_sort(size_t begin, size_t end)
+        {
+            if(is_empty_range(begin, end))
+                return;
+            
+            check_valid_range(begin, end, size());
+            
+            const size_t n = end - begin;
+            
+            std::vector<T> keys(n);
+            unpack(begin, end, keys.data());
+            
+            // Histograms aren't worth it for a few fields
+            if(n < 256) {
+                std::sort(keys.begin(), keys.end());
+                pack(keys.data(), n, begin);
+                return;
+            }
+            
+            const size_t passes = ceildiv(width(), 11);
+            const size_t digit  = ceildiv(width(), passes);
+            const size_t radix  = size_t(1) << digit;
+            const T mask = T(radix - 1);
+            
+            std::vector<size_t> counts(passes * radix);
+            for(T key : keys)
+                for(size_t d = 0; d < passes; ++d)
+                    ++counts[d * radix + size_t((key >> (d * digit)) & mask)];
+            
+            std::vector<T> scratch(n);
+            for(size_t d = 0; d < passes; ++d)
+            {
+                size_t shift = d * digit;
+                size_t *count = counts.data() + d * radix;
+                
+                if(count[size_t((keys[0] >> shift) & mask)] == n)
+                    continue;
+                
+                for(size_t i = 0, sum = 0; i < radix; ++i) {
+                    size_t c = count[i];
+                    count[i] = sum;
+                    sum += c;
+                }
+                
+                for(T key : keys)
+                    scratch[count[size_t((key >> shift) & mask)]++] = key;
+                
+                keys.swap(scratch);
+            }
+            
+            pack(keys.data(), n, begin);
+        }
+        
+        template<template<typename ...> class C, size_t Wd, typename Word>
+        template<typename F>
+        void
+        packed_view<C, Wd, Word>::for_each(size_t begin, size_t end, F f) const
+        {
+            word_type buffer[chunk_size];
+            
+            for(size_t b = begin; b < end; b += chunk_size)
+            {
+                size_t n = std::min(end - b, size_t(chunk_size));
+                
+                unpack(b, b + n, buffer);
+                for(size_t i = 0; i < n; ++i)
+                    f(buffer[i]);
+            }
+        }
+        
+        template<template<typename ...> class C, size_t Wd, typename Word>
+        template<typename F>
+        void packed_view<C, Wd, Word>::transform(size_t begin, size_t end, F f)
         {
-            increment(begin, end, - n, may_overflow);
+            word_type buffer[chunk_size];
+            
+            for(size_t b = begin; b < end; b += chunk_size)
+            {
+                size_t n = std::min(end - b, size_t(chunk_size));
+                
+                unpack(b, b + n, buffer);
+                for(size_t i = 0; i < n; ++i)
+                    buffer[i] = word_type(f(buffer[i]));
+                pack(buffer, n, b);
+            }
         }
         
-        template<template<typename ...> class C1>
-        template<template<typename ...> class C2>
-        void packed_view<C1>::copy(packed_view<C2> const&src,
-                                  size_t src_begin, size_t src_end,
-                                  size_t dest_begin, size_t dest_end)
+        template<template<typename ...> class C1, size_t Wd1, typename Word>
+        template<template<typename ...> class C2, size_t Wd2>
+        void
+        packed_view<C1, Wd1, Word>::copy(packed_view<C2, Wd2, Word> const&src,
+                                         size_t src_begin, size_t src_end,
+                                         size_t dest_begin, size_t dest_end)
         {
-            _bits.copy(src._bits,
+            _bits.copy(src.bits(),
                        src_begin  * src.width(),
                        src_end    * src.width(),
                        dest_begin *     width(),
                        dest_end   *     width());
         }
         
-        template<template<typename ...> class C>
-        std::string packed_view<C>::to_binary(size_t begin, size_t end,
-                                              size_t sep, char ssep) const
+        template<template<typename ...> class C, size_t Wd, typename Word>
+        std::string
+        packed_view<C, Wd, Word>::to_binary(size_t begin, size_t end,
+                                            size_t sep, char ssep) const
         {
             return bits().to_binary(begin * width(), end * width(),
                                     sep, ssep);
         }
     
-        template<template<typename ...> class C>
+        template<template<typename ...> class C, size_t Wd, typename Word>
         template<bool IsConst>
-        class packed_view<C>::packed_iterator {
+        class packed_view<C, Wd, Word>::packed_iterator {
             friend class packed_view;
             
             using view_t = typename
@@ -460,8 +1364,9 @@ namespace bv
         };
     } // namespace internal
     
-    // Public thing
+    // Public things
     using internal::packed_view;
+    using internal::packed_array;
     
 } // namespace bv
 
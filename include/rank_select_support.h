@@ -0,0 +1,346 @@
+/*
+ * Copyright 2014 Nicola Gigante
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PACKED_BITVECTOR_RANK_SELECT_SUPPORT_H
+#define PACKED_BITVECTOR_RANK_SELECT_SUPPORT_H
+
+#include "bitview.h"
+#include "internal/bits.h"
+#include "internal/simd.h"
+
+#include <vector>
+#include <thread>
+
+namespace bv
+{
+    namespace internal {
+        
+        /*
+         * Constant time rank and fast select over the bits of a bitview,
+         * which is referenced and not copied, so it must outlive this object
+         * and it must not change after build().
+         *
+         * The directory interleaves, for each block of 512 bits, the number
+         * of set bits before the block and a word packing seven 9 bits
+         * counts of the set bits before each word of the block, relative to
+         * the block. So rank() needs the two directory words, which lay on
+         * the same cache line, and the popcount of one word.
+         * To select, one block every 4096 set bits is sampled, then the
+         * blocks between two samples are binary searched.
+         */
+        template<template<typename ...> class Container>
+        class rank_select_support
+        {
+        public:
+            using word_type = bitview_base<>::word_type;
+            
+            static constexpr size_t W = bitsize<word_type>();
+            
+            // Words in each block of the directory
+            static constexpr size_t block_words = 8;
+            
+            // Number of set bits between two select samples
+            static constexpr size_t sample_rate = 4096;
+            
+            rank_select_support() = default;
+            
+            /*
+             * Builds the directory using the given number of threads.
+             * With one thread the bits are scanned once, while with more
+             * threads each one counts the bits of its own blocks, and then
+             * the partial counts are adjusted.
+             */
+            explicit rank_select_support(bitview<Container> const&bits,
+                                         size_t threads = 1)
+                : _bits(&bits)
+            {
+                build(threads);
+            }
+            
+            // Rebuilds the directory, e.g. after the bits have changed
+            void build(size_t threads = 1);
+            
+            // Number of bits of the underlying bitview
+            size_t size() const { return _bits ? _bits->size() : 0; }
+            
+            // Total number of set bits
+            size_t count() const { return _count; }
+            
+            // Number of set bits in the range [0, index)
+            size_t rank(size_t index) const;
+            
+            // Index of the set bit with the given rank, starting from zero.
+            // The rank must be less than count().
+            size_t select(size_t rank) const;
+            
+            // Bytes taken by the directory and the samples
+            size_t memory() const {
+                return (_directory.size() + _samples.size()) *
+                       sizeof(word_type);
+            }
+        
+        private:
+            static constexpr size_t block_bits = block_words * W;
+            
+            // Mask with the high bit of each of the seven relative counts
+            static constexpr word_type count_flags = 0x4020100804020100;
+            static constexpr word_type count_ones  = 0x0040201008040201;
+            
+            size_t words() const { return _bits->container().size(); }
+            
+            size_t blocks() const { return ceildiv(words(), block_words); }
+            
+            word_type absolute(size_t block) const {
+                return _directory[2 * block];
+            }
+            
+            word_type relative(size_t block, size_t word) const {
+                return word == 0 ? 0
+                     : (_directory[2 * block + 1] >> (9 * (word - 1))) & 0x1FF;
+            }
+            
+            word_type count_blocks(size_t begin, size_t end);
+            void offset_blocks(size_t begin, size_t end, word_type offset);
+            void sample_blocks(size_t begin, size_t end);
+            
+            static size_t select_in_word(word_type word, size_t rank);
+            
+            template<typename F>
+            static void parallel_for(size_t n, size_t threads, F f);
+        
+        private:
+            bitview<Container> const*_bits = nullptr;
+            
+            // Two words for each block, plus a final pair with the total
+            std::vector<word_type> _directory;
+            
+            // Block containing each sample_rate-th set bit, plus a sentinel
+            std::vector<word_type> _samples;
+            
+            size_t _count = 0;
+        };
+        
+        /*
+         * Calls f(begin, end) on 'threads' consecutive slices of [0, n).
+         * The first slice is processed by the calling thread.
+         */
+        template<template<typename ...> class C>
+        template<typename F>
+        void rank_select_support<C>::parallel_for(size_t n, size_t threads,
+                                                  F f)
+        {
+            size_t chunk = ceildiv(n, threads);
+            
+            std::vector<std::thread> workers;
+            for(size_t t = 1; t < threads; ++t)
+                workers.emplace_back(f, std::min(t * chunk, n),
+                                        std::min((t + 1) * chunk, n));
+            
+            f(size_t(0), std::min(chunk, n));
+            
+            for(std::thread &worker : workers)
+                worker.join();
+        }
+        
+        template<template<typename ...> class C>
+        void rank_select_support<C>::build(size_t threads)
+        {
+            assert(_bits != nullptr);
+            
+            size_t n = blocks();
+            
+            _directory.assign(2 * n + 2, 0);
+            
+            // Don't bother threads with less than 1024 blocks (64KB) each
+            threads = std::max<size_t>(1, std::min(threads, n / 1024));
+            
+            if(threads == 1) {
+                _count = count_blocks(0, n);
+            } else {
+                size_t chunk = ceildiv(n, threads);
+                std::vector<word_type> totals(threads);
+                
+                parallel_for(n, threads, [&](size_t begin, size_t end) {
+                    if(begin < end)
+                        totals[begin / chunk] = count_blocks(begin, end);
+                });
+                
+                for(size_t t = 1; t < threads; ++t)
+                    totals[t] += totals[t - 1];
+                
+                parallel_for(n, threads, [&](size_t begin, size_t end) {
+                    if(begin < end && begin != 0)
+                        offset_blocks(begin, end, totals[begin / chunk - 1]);
+                });
+                
+                _count = totals.back();
+            }
+            
+            _directory[2 * n] = _count;
+            
+            _samples.assign(ceildiv(_count, sample_rate) + 1, 0);
+            _samples.back() = n == 0 ? 0 : n - 1;
+            
+            parallel_for(n, threads, [&](size_t begin, size_t end) {
+                sample_blocks(begin, end);
+            });
+        }
+        
+        /*
+         * Fills the directory entries of the blocks in [begin, end), with
+         * absolute counts relative to the first block. Returns the number
+         * of set bits in the blocks.
+         */
+        template<template<typename ...> class C>
+        typename rank_select_support<C>::word_type
+        rank_select_support<C>::count_blocks(size_t begin, size_t end)
+        {
+            auto const&container = _bits->container();
+            const size_t nwords = words();
+            
+            word_type total = 0;
+            for(size_t b = begin; b < end; ++b)
+            {
+                word_type rel = 0;
+                word_type inblock = 0;
+                
+                for(size_t w = 0; w < block_words; ++w)
+                {
+                    size_t i = b * block_words + w;
+                    
+                    if(w != 0)
+                        rel |= inblock << (9 * (w - 1));
+                    if(i < nwords)
+                        inblock += popcount(container[i]);
+                }
+                
+                _directory[2 * b] = total;
+                _directory[2 * b + 1] = rel;
+                
+                total += inblock;
+            }
+            
+            return total;
+        }
+        
+        template<template<typename ...> class C>
+        void rank_select_support<C>::offset_blocks(size_t begin, size_t end,
+                                                   word_type offset)
+        {
+            for(size_t b = begin; b < end; ++b)
+                _directory[2 * b] += offset;
+        }
+        
+        /*
+         * Each block records itself as the sample of the set bits of rank
+         * multiple of sample_rate that it contains, so different blocks
+         * write different samples.
+         */
+        template<template<typename ...> class C>
+        void rank_select_support<C>::sample_blocks(size_t begin, size_t end)
+        {
+            for(size_t b = begin; b < end; ++b)
+            {
+                word_type first = absolute(b);
+                word_type last  = absolute(b + 1);
+                
+                for(size_t s = ceildiv(first, sample_rate);
+                    s * sample_rate < last; ++s)
+                {
+                    _samples[s] = b;
+                }
+            }
+        }
+        
+        template<template<typename ...> class C>
+        size_t rank_select_support<C>::rank(size_t index) const
+        {
+            assert(index <= size());
+            
+            size_t block = index / block_bits;
+            size_t word  = index / W;
+            
+            size_t result = absolute(block) +
+                            relative(block, word % block_words);
+            
+            if(index % W != 0)
+                result += popcount(lowbits(_bits->container()[word],
+                                           index % W));
+            
+            return result;
+        }
+        
+        template<template<typename ...> class C>
+        size_t rank_select_support<C>::select(size_t rank) const
+        {
+            assert(rank < count());
+            
+            // The last block with at most 'rank' set bits before it
+            size_t lo = _samples[rank / sample_rate];
+            size_t hi = _samples[rank / sample_rate + 1];
+            while(lo < hi) {
+                size_t mid = lo + (hi - lo + 1) / 2;
+                
+                if(absolute(mid) <= rank)
+                    lo = mid;
+                else
+                    hi = mid - 1;
+            }
+            
+            rank -= absolute(lo);
+            
+            // The relative counts not greater than rank tell the word
+            word_type rel = _directory[2 * lo + 1];
+            word_type le = fields_greater_equal(count_ones * rank, rel,
+                                                count_flags);
+            size_t word = popcount(le);
+            
+            rank -= relative(lo, word);
+            
+            size_t index = lo * block_words + word;
+            
+            return index * W + select_in_word(_bits->container()[index], rank);
+        }
+        
+        template<template<typename ...> class C>
+        size_t rank_select_support<C>::select_in_word(word_type word,
+                                                      size_t rank)
+        {
+            assert(rank < popcount(word));
+
+#if defined(__BMI2__)
+            return trailing_zeros(deposit_bits(word_type(1) << rank, word));
+#else
+            size_t shift = 0;
+            for(size_t c; rank >= (c = popcount(word & 0xFF)); rank -= c) {
+                word >>= 8;
+                shift += 8;
+            }
+            
+            for(; rank > 0; --rank)
+                word &= word - 1;
+            
+            return shift + trailing_zeros(word);
+#endif
+        }
+    
+    } // namespace internal
+    
+    // Public things
+    using internal::rank_select_support;
+} // namespace bv
+
+#endif
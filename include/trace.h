@@ -0,0 +1,245 @@
+/*
+ * Copyright 2014 Nicola Gigante
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PACKED_BITVECTOR_TRACE_H
+#define PACKED_BITVECTOR_TRACE_H
+
+#include "internal/bits.h"
+
+#include <istream>
+#include <ostream>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+
+/*
+ * Binary traces of the operations performed on a bitvector, recorded by
+ * bitvector_t::trace() and replayed by test/replay.
+ *
+ * A trace begins with a header: the 8 bytes "BVTRACE1", then the capacity,
+ * the node width, the leaf width and the size of the bitvector when the
+ * recording started, as 64 bits little endian integers, then its bits,
+ * packed eight per byte from the least significant bit.
+ *
+ * Each operation follows as a byte, with the kind of operation in the two
+ * lowest bits and the bit argument of rank, set or insert in the third,
+ * then the difference from the index of the previous operation, zigzag
+ * encoded in a LEB128 varint, so local patterns take a couple of bytes.
+ */
+namespace bv
+{
+    namespace internal {
+        
+        enum class trace_op : uint8_t {
+            access = 0,
+            rank   = 1,
+            set    = 2,
+            insert = 3
+        };
+        
+        struct trace_record {
+            trace_op op;
+            size_t index;
+            bool bit;
+        };
+        
+        struct trace_header {
+            size_t capacity;
+            size_t node_width;
+            size_t leaf_width;
+            
+            // Bits of the bitvector when the recording started
+            std::vector<bool> initial;
+        };
+        
+        constexpr char trace_magic[] = "BVTRACE1";
+        
+        /*
+         * Writes the operations to a stream, if any. Copies of the writer,
+         * made by copying a traced bitvector, don't write anything, since
+         * their operations don't belong to the trace.
+         */
+        class trace_writer
+        {
+        public:
+            trace_writer() = default;
+            
+            trace_writer(trace_writer const&) { }
+            trace_writer &operator=(trace_writer const&) {
+                _out = nullptr;
+                return *this;
+            }
+            
+            bool active() const { return _out != nullptr; }
+            
+            // Writes the header and starts the recording on out, or stops
+            // it if out is null
+            void start(std::ostream *out, trace_header const&h);
+            
+            void write(trace_op op, size_t index, bool bit);
+        
+        private:
+            void write_word(uint64_t w) {
+                for(size_t i = 0; i < 8; ++i)
+                    _out->put(char(w >> (8 * i)));
+            }
+        
+        private:
+            std::ostream *_out = nullptr;
+            size_t _last = 0;
+        };
+        
+        inline void trace_writer::start(std::ostream *out,
+                                        trace_header const&h)
+        {
+            _out = out;
+            _last = 0;
+            if(!_out)
+                return;
+            
+            _out->write(trace_magic, sizeof(trace_magic) - 1);
+            write_word(h.capacity);
+            write_word(h.node_width);
+            write_word(h.leaf_width);
+            write_word(h.initial.size());
+            
+            for(size_t i = 0; i < h.initial.size(); i += 8) {
+                uint8_t byte = 0;
+                for(size_t j = i; j < std::min(i + 8, h.initial.size()); ++j)
+                    byte |= uint8_t(h.initial[j]) << (j - i);
+                _out->put(char(byte));
+            }
+        }
+        
+        inline void trace_writer::write(trace_op op, size_t index, bool bit)
+        {
+            _out->put(char(uint8_t(op) | uint8_t(bit) << 2));
+            
+            int64_t delta = int64_t(index - _last);
+            uint64_t zigzag = (uint64_t(delta) << 1) ^ uint64_t(delta >> 63);
+            _last = index;
+            
+            while(zigzag >= 0x80) {
+                _out->put(char(zigzag | 0x80));
+                zigzag >>= 7;
+            }
+            _out->put(char(zigzag));
+        }
+        
+        /*
+         * Reads a trace. If the stream doesn't begin with a valid header,
+         * whose initial bits are all there and not more than the capacity,
+         * valid() is false and there are no records.
+         */
+        class trace_reader
+        {
+        public:
+            explicit trace_reader(std::istream &in);
+            
+            bool valid() const { return _valid; }
+            trace_header const&header() const { return _header; }
+            
+            // Reads the next record, returning false at the end of the
+            // trace or if it's truncated
+            bool next(trace_record &r);
+        
+        private:
+            bool read_word(uint64_t &w) {
+                unsigned char bytes[8];
+                if(!_in.read(reinterpret_cast<char *>(bytes), 8))
+                    return false;
+                
+                w = 0;
+                for(size_t i = 0; i < 8; ++i)
+                    w |= uint64_t(bytes[i]) << (8 * i);
+                return true;
+            }
+        
+        private:
+            std::istream &_in;
+            bool _valid = false;
+            trace_header _header = trace_header();
+            size_t _last = 0;
+        };
+        
+        inline trace_reader::trace_reader(std::istream &in) : _in(in)
+        {
+            char magic[sizeof(trace_magic) - 1];
+            uint64_t capacity, node_width, leaf_width, size;
+            if(!_in.read(magic, sizeof(magic)) ||
+               std::memcmp(magic, trace_magic, sizeof(magic)) != 0 ||
+               !read_word(capacity) || !read_word(node_width) ||
+               !read_word(leaf_width) || !read_word(size) || size > capacity)
+                return;
+            
+            _header.capacity = capacity;
+            _header.node_width = node_width;
+            _header.leaf_width = leaf_width;
+            
+            // The size comes from the stream, so the bits are stored as they
+            // are read, rather than allocated all at once
+            for(size_t i = 0; i < size; i += 8) {
+                int byte = _in.get();
+                if(byte == std::istream::traits_type::eof())
+                    return;
+                for(size_t j = i; j < std::min<size_t>(i + 8, size); ++j)
+                    _header.initial.push_back((byte >> (j - i)) & 1);
+            }
+            
+            _valid = true;
+        }
+        
+        inline bool trace_reader::next(trace_record &r)
+        {
+            if(!_valid)
+                return false;
+            
+            int op = _in.get();
+            if(op == std::istream::traits_type::eof())
+                return false;
+            
+            uint64_t zigzag = 0;
+            for(size_t shift = 0; ; shift += 7) {
+                int byte = _in.get();
+                if(byte == std::istream::traits_type::eof() || shift > 63)
+                    return false;
+                
+                zigzag |= uint64_t(byte & 0x7F) << shift;
+                if(!(byte & 0x80))
+                    break;
+            }
+            
+            int64_t delta = int64_t(zigzag >> 1) ^ -int64_t(zigzag & 1);
+            _last += size_t(delta);
+            
+            r.op = trace_op(op & 3);
+            r.index = _last;
+            r.bit = (op >> 2) & 1;
+            
+            return true;
+        }
+    
+    } // namespace internal
+    
+    // Public things
+    using internal::trace_op;
+    using internal::trace_record;
+    using internal::trace_header;
+    using internal::trace_reader;
+} // namespace bv
+
+#endif
@@ -0,0 +1,285 @@
+/*
+ * Copyright 2014 Nicola Gigante
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "bench.h"
+
+#include "bitvector.h"
+
+#include <vector>
+#include <random>
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+
+using namespace bv;
+
+/*
+ * Autotuner of the leaf width W and of the node width Wn.
+ *
+ * For each W among the compiled-in instantiations and each Wn among the
+ * values given by --node-widths, a bitvector of capacity --size is filled
+ * to half and then runs a mix of operations, given by --mix as weights,
+ * which fills the other half. The time of the mix, the memory used and the
+ * height of the tree are reported, and the fastest configuration is
+ * written as a header to --output, to be included before bitvector.h.
+ */
+
+enum op_kind { append_op, insert_op, access_op, rank_op, set_op, op_kinds };
+
+const char *op_names[] = { "append", "insert", "access", "rank", "set" };
+
+struct operation {
+    op_kind kind;
+    size_t index;
+};
+
+// A configuration and its results
+struct outcome {
+    size_t W;
+    size_t Wn;
+    size_t height;
+    size_t degree;
+    double bits_per_bit;
+    bench::result timing;
+};
+
+// Parses weights like "insert=2,access=1" into the probability of each
+// kind of operation
+std::vector<double> parse_mix(std::string const&s)
+{
+    std::vector<double> weights(op_kinds, 0);
+    std::istringstream in(s);
+    for(std::string item; std::getline(in, item, ',');)
+    {
+        std::string name = item.substr(0, item.find('='));
+        size_t k = std::find(op_names, op_names + op_kinds, name) - op_names;
+        if(k == op_kinds || item.find('=') == std::string::npos) {
+            std::cerr << "Unknown operation in the mix: " << item << "\n";
+            std::exit(1);
+        }
+        weights[k] = std::strtod(item.c_str() + name.size() + 1, nullptr);
+    }
+    
+    return weights;
+}
+
+/*
+ * The operations of the mix, starting from a vector of 'initial' bits.
+ * They are the same for every configuration. Appends and insertions grow
+ * the vector, so indexes are drawn from its size at each point.
+ */
+std::vector<operation> make_mix(std::vector<double> const&weights,
+                                size_t initial, size_t n,
+                                std::mt19937_64 &engine)
+{
+    std::discrete_distribution<int> kinds(weights.begin(), weights.end());
+    
+    // Only appends and insertions are possible on an empty vector, which
+    // come first among the kinds
+    std::vector<double> growing = { weights[append_op], weights[insert_op] };
+    if(growing[append_op] + growing[insert_op] == 0)
+        growing[append_op] = 1;
+    std::discrete_distribution<int> growing_kinds(growing.begin(),
+                                                  growing.end());
+    
+    std::vector<operation> ops(n);
+    size_t size = initial;
+    for(operation &op : ops) {
+        op.kind = op_kind(size > 0 ? kinds(engine) : growing_kinds(engine));
+        
+        bool grows = op.kind == append_op || op.kind == insert_op;
+        op.index = engine() % (size + grows);
+        size += grows;
+    }
+    
+    return ops;
+}
+
+template<size_t W>
+void tune(bench::options const&opts, std::vector<size_t> const&widths,
+          std::vector<operation> const&ops, std::vector<outcome> &outcomes)
+{
+    using bitvector_type = bitvector_t<W, alloc_on_demand>;
+    
+    const size_t N = opts.size;
+    
+    for(size_t Wn : widths)
+    {
+        if(!bitvector_type::valid_node_width(N, Wn)) {
+            std::cerr << "Skipping W = " << W << ", Wn = " << Wn
+                      << ": nodes too narrow for the capacity\n";
+            continue;
+        }
+        
+        auto setup = [&] {
+            bitvector_type v(N, Wn);
+            for(size_t i = 0; i < N / 2; ++i)
+                v.push_back(i % 3 == 0);
+            return v;
+        };
+        
+        auto body = [&](bitvector_type &v) {
+            size_t x = 0;
+            for(operation const&op : ops) {
+                switch(op.kind) {
+                    case append_op: v.push_back(op.index % 2);        break;
+                    case insert_op: v.insert(op.index, op.index % 2); break;
+                    case access_op: x += v.access(op.index);          break;
+                    case rank_op:   x += v.rank(op.index);            break;
+                    case set_op:    v.set(op.index, op.index % 2);    break;
+                    case op_kinds:                                    break;
+                }
+            }
+            bench::do_not_optimize(x);
+        };
+        
+        std::string name = "W=" + std::to_string(W) +
+                           "/Wn=" + std::to_string(Wn);
+        
+        bench::result timing = bench::measure(opts, name, ops.size(),
+                                              setup, body);
+        
+        // The shape of the tree after the mix
+        bitvector_type v = setup();
+        body(v);
+        
+        outcomes.push_back({ W, Wn, v.info().height, v.info().degree,
+                             double(v.memory()) / v.size(), timing });
+    }
+}
+
+template<size_t ...Ws>
+void sweep(bench::options const&opts, std::vector<size_t> const&widths,
+           std::vector<operation> const&ops, std::vector<outcome> &outcomes)
+{
+    int expand[] = { (tune<Ws>(opts, widths, ops, outcomes), 0)... };
+    internal::unused(expand);
+}
+
+void print(bench::options const&opts, std::vector<outcome> const&outcomes)
+{
+    std::ostream &out = std::cout;
+    
+    if(opts.format == "csv")
+        out << "W,Wn,height,degree,bits_per_bit,p50_ns,mops_per_s\n";
+    else if(opts.format == "json")
+        out << "[";
+    else
+        out << std::setw(6) << "W" << std::setw(7) << "Wn"
+            << std::setw(8) << "height" << std::setw(8) << "degree"
+            << std::setw(10) << "bits/bit" << std::setw(10) << "ns/op"
+            << std::setw(10) << "Mops/s" << "\n";
+    
+    for(size_t i = 0; i < outcomes.size(); ++i)
+    {
+        outcome const&o = outcomes[i];
+        double p50 = o.timing.percentile(50);
+        
+        if(opts.format == "csv")
+            out << o.W << "," << o.Wn << "," << o.height << "," << o.degree
+                << "," << o.bits_per_bit << "," << p50 << ","
+                << 1000 / p50 << "\n";
+        else if(opts.format == "json")
+            out << (i == 0 ? "\n" : ",\n")
+                << "  { \"W\": " << o.W << ", \"Wn\": " << o.Wn
+                << ", \"height\": " << o.height
+                << ", \"degree\": " << o.degree
+                << ", \"bits_per_bit\": " << o.bits_per_bit
+                << ", \"p50_ns\": " << p50
+                << ", \"mops_per_s\": " << 1000 / p50 << " }";
+        else
+            out << std::setw(6) << o.W << std::setw(7) << o.Wn
+                << std::setw(8) << o.height << std::setw(8) << o.degree
+                << std::fixed << std::setprecision(3)
+                << std::setw(10) << o.bits_per_bit
+                << std::setprecision(1)
+                << std::setw(10) << p50 << std::setw(10) << 1000 / p50
+                << "\n";
+        out.unsetf(std::ios::fixed);
+    }
+    
+    if(opts.format == "json")
+        out << "\n]\n";
+}
+
+void write_config(std::string const&path, bench::options const&opts,
+                  std::string const&mix, outcome const&best)
+{
+    std::ofstream out(path);
+    
+    out << "/*\n"
+        << " * bitvector configuration generated by test/autotune\n"
+        << " * for a capacity of " << opts.size << " bits"
+        << " and the operations mix\n"
+        << " * " << mix << ".\n"
+        << " * Measured " << best.timing.percentile(50) << " ns/op"
+        << " and " << best.bits_per_bit << " bits of memory per bit.\n"
+        << " * Include it before bitvector.h.\n"
+        << " */\n"
+        << "\n"
+        << "#ifndef PACKED_BITVECTOR_CONFIG_H\n"
+        << "#define PACKED_BITVECTOR_CONFIG_H\n"
+        << "\n"
+        << "#define PACKED_BITVECTOR_LEAF_WIDTH " << best.W << "\n"
+        << "#define PACKED_BITVECTOR_NODE_WIDTH " << best.Wn << "\n"
+        << "\n"
+        << "#endif\n";
+    
+    if(!out) {
+        std::cerr << "Can't write " << path << "\n";
+        std::exit(1);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    bench::options opts(argc, argv, { "mix", "node-widths", "output" });
+    
+    std::string mix = opts.param("mix", "insert=1,access=1,rank=1,set=1");
+    std::vector<size_t> widths =
+        bench::parse_list(opts.param("node-widths", "128,256,512,1024,2048"));
+    std::string output = opts.param("output", "bitvector_config.h");
+    
+    std::mt19937_64 engine(42);
+    std::vector<operation> ops = make_mix(parse_mix(mix), opts.size / 2,
+                                          opts.size - opts.size / 2, engine);
+    
+    std::vector<outcome> outcomes;
+    // The leaf widths must be known at compile time
+    sweep<256, 512, 1024, 2048, 4096>(opts, widths, ops, outcomes);
+    
+    if(outcomes.empty()) {
+        std::cerr << "No valid configuration to try\n";
+        return 1;
+    }
+    
+    print(opts, outcomes);
+    
+    outcome const&best =
+        *std::min_element(outcomes.begin(), outcomes.end(),
+                          [](outcome const&a, outcome const&b) {
+                              return a.timing.percentile(50) <
+                                     b.timing.percentile(50);
+                          });
+    
+    write_config(output, opts, mix, best);
+    
+    std::cerr << "Recommended W = " << best.W << ", Wn = " << best.Wn
+              << ", written to " << output << "\n";
+}
@@ -0,0 +1,281 @@
+/*
+ * Copyright 2014 Nicola Gigante
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "bench.h"
+#include "workloads.h"
+
+#include "bitvector.h"
+#include "bitview.h"
+#include "packed_view.h"
+
+#include <vector>
+#include <random>
+#include <functional>
+
+using namespace bv;
+
+/*
+ * Benchmarks of the bitvector operations, plus scans of the views.
+ * Run with --help for the options. The bitvector holds --size bits, and
+ * each benchmark performs that many operations.
+ *
+ * The latency/ benchmarks repeat the workloads timing each operation, to
+ * report the tail latencies, e.g. of the insertions that redistribute the
+ * bits among the leaves or split the root.
+ *
+ * The workloads of workloads.h run as both. The LF walk builds the BWT of
+ * the first --size characters of the --text file, or of a synthetic
+ * repetitive text.
+ */
+
+// Leaf width of the benchmarked bitvector, and width of the nodes
+constexpr size_t W = 2048;
+constexpr size_t Wn = 256;
+
+using bitvector_type = bitvector_t<W, alloc_on_demand>;
+
+// A bitvector of n random bits, built by appending
+bitvector_type make_bitvector(size_t n, std::mt19937_64 &engine)
+{
+    bitvector_type v(n, Wn);
+    for(size_t i = 0; i < n; ++i)
+        v.push_back(engine() % 2);
+    
+    return v;
+}
+
+void workloads(bench::suite &suite, std::mt19937_64 &engine)
+{
+    const size_t N = suite.opts().size;
+    
+    auto empty = [&] { return bitvector_type(N, Wn); };
+    
+    auto run = [&](std::string const&name,
+                   std::vector<bench::operation> const&ops) {
+        suite.run("bitvector/" + name, ops.size(), empty,
+                  [&](bitvector_type &v) {
+            size_t x = 0;
+            for(bench::operation const&op : ops)
+                bench::apply(v, op, x);
+            bench::do_not_optimize(x);
+        });
+        
+        suite.run_latency("latency/" + name,
+                          { "access", "rank", "set", "insert" }, empty,
+                          [&](bitvector_type &v, bench::latency_recorder &l) {
+            size_t x = 0;
+            for(bench::operation const&op : ops)
+                l.time(size_t(op.op), [&] { bench::apply(v, op, x); });
+            bench::do_not_optimize(x);
+        });
+    };
+    
+    run("zipf_insert",
+        bench::insertions(bench::zipf_positions(N, engine), engine));
+    run("append_heavy_insert",
+        bench::insertions(bench::append_heavy_positions(N, engine), engine));
+    
+    std::string path = suite.opts().param("text", "");
+    std::string text = path.empty() ? bench::repetitive_text(N, engine)
+                                    : bench::read_text(path, N);
+    if(text.empty() && N > 0) {
+        std::cerr << "Can't read a text from " << path << "\n";
+        std::exit(1);
+    }
+    run("lf_walk", bench::lf_walk(text));
+    
+    // Reads and writes in a given ratio, with the writes in hot regions
+    for(size_t reads : { 50, 90 })
+    {
+        size_t writes = N * (100 - reads) / 100;
+        std::vector<bench::operation> ops = bench::with_reads(
+            bench::insertions(bench::zipf_positions(writes, engine), engine),
+            reads / 100.0, engine);
+        
+        run("read_write/r" + std::to_string(reads), ops);
+    }
+}
+
+void latencies(bench::suite &suite, std::mt19937_64 &engine)
+{
+    using bench::latency_recorder;
+    
+    const size_t N = suite.opts().size;
+    
+    auto empty = [&] { return bitvector_type(N, Wn); };
+    
+    suite.run_latency("latency/append", { "push_back" }, empty,
+                      [&](bitvector_type &v, latency_recorder &l) {
+        for(size_t i = 0; i < N; ++i)
+            l.time(0, [&] { v.push_back(i % 3 == 0); });
+    });
+    
+    std::vector<size_t> positions = bench::uniform_positions(N, engine);
+    suite.run_latency("latency/random_insert", { "insert" }, empty,
+                      [&](bitvector_type &v, latency_recorder &l) {
+        for(size_t i = 0; i < N; ++i)
+            l.time(0, [&] { v.insert(positions[i], i % 3 == 0); });
+    });
+    
+    positions = bench::clustered_positions(N, engine);
+    suite.run_latency("latency/clustered_insert", { "insert" }, empty,
+                      [&](bitvector_type &v, latency_recorder &l) {
+        for(size_t i = 0; i < N; ++i)
+            l.time(0, [&] { v.insert(positions[i], i % 3 == 0); });
+    });
+    
+    // Queries on a full bitvector
+    bitvector_type full = make_bitvector(N, engine);
+    auto shared = [&] { return std::ref(full); };
+    
+    std::vector<size_t> indexes(N);
+    for(size_t &i : indexes)
+        i = engine() % N;
+    
+    suite.run_latency("latency/queries", { "access", "rank" }, shared,
+                      [&](bitvector_type &v, latency_recorder &l) {
+        size_t sum = 0;
+        for(size_t k = 0; k < N; ++k) {
+            size_t i = indexes[k];
+            if(k % 2 == 0)
+                l.time(0, [&] { sum += v.access(i); });
+            else
+                l.time(1, [&] { sum += v.rank(i); });
+        }
+        bench::do_not_optimize(sum);
+    });
+    
+    // Updates and queries interleaved, on a bitvector filled to half,
+    // which the insertions fill up
+    auto half = [&] {
+        bitvector_type v(N, Wn);
+        for(size_t i = 0; i < N / 2; ++i)
+            v.push_back(i % 3 == 0);
+        return v;
+    };
+    
+    std::vector<size_t> draws(N - N / 2);
+    for(size_t &d : draws)
+        d = engine();
+    
+    suite.run_latency("latency/mixed", { "insert", "access", "rank", "set" },
+                      half, [&](bitvector_type &v, latency_recorder &l) {
+        size_t sum = 0;
+        for(size_t k = 0; k < draws.size(); ++k) {
+            // Only insertions are possible on an empty bitvector
+            size_t kind = v.empty() ? 0 : draws[k] % 4;
+            size_t i = v.empty() ? 0 : draws[k] / 4 % v.size();
+            switch(kind) {
+                case 0: l.time(0, [&] { v.insert(i, k % 2); }); break;
+                case 1: l.time(1, [&] { sum += v.access(i); }); break;
+                case 2: l.time(2, [&] { sum += v.rank(i); });   break;
+                case 3: l.time(3, [&] { v.set(i, k % 2); });    break;
+            }
+        }
+        bench::do_not_optimize(sum);
+    });
+}
+
+int main(int argc, char **argv)
+{
+    bench::suite suite(argc, argv, { "text" });
+    
+    const size_t N = suite.opts().size;
+    
+    std::mt19937_64 engine(42);
+    
+    auto empty = [&] { return bitvector_type(N, Wn); };
+    
+    suite.run("bitvector/append", N, empty, [&](bitvector_type &v) {
+        for(size_t i = 0; i < N; ++i)
+            v.push_back(i % 3 == 0);
+    });
+    
+    std::vector<size_t> positions = bench::uniform_positions(N, engine);
+    suite.run("bitvector/random_insert", N, empty, [&](bitvector_type &v) {
+        for(size_t i = 0; i < N; ++i)
+            v.insert(positions[i], i % 3 == 0);
+    });
+    
+    positions = bench::clustered_positions(N, engine);
+    suite.run("bitvector/clustered_insert", N, empty, [&](bitvector_type &v) {
+        for(size_t i = 0; i < N; ++i)
+            v.insert(positions[i], i % 3 == 0);
+    });
+    
+    // The following benchmarks work on the same full bitvector
+    bitvector_type full = make_bitvector(N, engine);
+    auto shared = [&] { return std::ref(full); };
+    
+    std::vector<size_t> indexes(N);
+    for(size_t &i : indexes)
+        i = engine() % N;
+    
+    suite.run("bitvector/access", N, shared, [&](bitvector_type &v) {
+        size_t count = 0;
+        for(size_t i : indexes)
+            count += v.access(i);
+        bench::do_not_optimize(count);
+    });
+    
+    suite.run("bitvector/rank", N, shared, [&](bitvector_type &v) {
+        size_t sum = 0;
+        for(size_t i : indexes)
+            sum += v.rank(i);
+        bench::do_not_optimize(sum);
+    });
+    
+    suite.run("bitvector/set", N, shared, [&](bitvector_type &v) {
+        for(size_t k = 0; k < N; ++k)
+            v.set(indexes[k], k % 2);
+    });
+    
+    suite.run("bitvector/scan", N, shared, [&](bitvector_type &v) {
+        size_t count = 0;
+        for(size_t i = 0; i < N; ++i)
+            count += v.access(i);
+        bench::do_not_optimize(count);
+    });
+    
+    // Sequential scans of the views, with an operation for each word
+    // or field
+    auto nothing = [] { return 0; };
+    
+    bitview<std::vector> bits(N * 64);
+    for(size_t i = 0; i < bits.container().size(); ++i)
+        bits.container()[i] = engine();
+    
+    suite.run("bitview/popcount", N, nothing, [&](int) {
+        bench::do_not_optimize(bits.popcount());
+    });
+    
+    // The largest value is missing, so find() scans everything
+    packed_view<std::vector> fields(12, N);
+    fields.transform(0, N, [&](uint64_t) { return engine() % 4095; });
+    
+    suite.run("packed_view/for_each", N, nothing, [&](int) {
+        uint64_t sum = 0;
+        fields.for_each(0, N, [&](uint64_t x) { sum += x; });
+        bench::do_not_optimize(sum);
+    });
+    
+    suite.run("packed_view/find", N, nothing, [&](int) {
+        bench::do_not_optimize(fields.find(0, N, 4095));
+    });
+    
+    workloads(suite, engine);
+    latencies(suite, engine);
+}
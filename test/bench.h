@@ -0,0 +1,473 @@
+/*
+ * Copyright 2014 Nicola Gigante
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PACKED_BITVECTOR_BENCH_H
+#define PACKED_BITVECTOR_BENCH_H
+
+#include <cstddef>
+#include <cstdlib>
+#include <cmath>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <map>
+#include <numeric>
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+
+#include "perf_counters.h"
+#include "latency.h"
+
+/*
+ * Minimal benchmark harness.
+ *
+ * A benchmark times a body performing a known number of operations, a few
+ * times to warm up and then for the requested repetitions, each on a fresh
+ * state built by an untimed setup. The time per operation of each
+ * repetition is reported as minimum, percentiles, maximum and mean, as a
+ * table, CSV or JSON. If the benchmark tells how many bytes it processes,
+ * the throughput at the median time is reported as well. With --counters,
+ * the hardware performance counters of each benchmark are reported too,
+ * as mean counts per operation.
+ *
+ * Latency benchmarks time each operation on its own instead, with the
+ * time stamp counter where available, and report the distribution of the
+ * latencies of each kind of operation over all the repetitions, to expose
+ * the rare slow operations that the mean time hides.
+ */
+namespace bench
+{
+    /*
+     * Command line options, as --name=value. Programs with options of their
+     * own list their names, and find the values with param().
+     */
+    struct options
+    {
+        size_t size   = 1000000;
+        size_t reps   = 10;
+        size_t warmup = 2;
+        std::string format = "text";
+        std::string filter;
+        bool counters = false;
+        std::map<std::string, std::string> params;
+        
+        options(int argc, char **argv,
+                std::vector<std::string> const&extra = { });
+        
+        // Tells if the benchmark with this name has to be run
+        bool selected(std::string const&name) const {
+            return name.find(filter) != std::string::npos;
+        }
+        
+        std::string param(std::string const&name,
+                          std::string const&def) const {
+            auto it = params.find(name);
+            return it == params.end() ? def : it->second;
+        }
+    };
+    
+    inline options::options(int argc, char **argv,
+                            std::vector<std::string> const&extra)
+    {
+        for(int i = 1; i < argc; ++i)
+        {
+            std::string arg = argv[i];
+            size_t eq = arg.find('=');
+            std::string key = arg.substr(0, eq);
+            std::string value = eq == std::string::npos ? ""
+                                                        : arg.substr(eq + 1);
+            
+            if(key == "--size")
+                size = std::strtoull(value.c_str(), nullptr, 10);
+            else if(key == "--reps")
+                reps = std::max<size_t>(1, std::strtoull(value.c_str(),
+                                                         nullptr, 10));
+            else if(key == "--warmup")
+                warmup = std::strtoull(value.c_str(), nullptr, 10);
+            else if(key == "--format")
+                format = value;
+            else if(key == "--filter")
+                filter = value;
+            else if(key == "--counters")
+                counters = value != "no";
+            else if(key.compare(0, 2, "--") == 0 &&
+                    std::find(extra.begin(), extra.end(), key.substr(2)) !=
+                    extra.end())
+                params[key.substr(2)] = value;
+            else {
+                std::cerr << "Usage: " << argv[0] << " [--size=N] [--reps=N]"
+                          << " [--warmup=N] [--format=text|csv|json]"
+                          << " [--filter=substring] [--counters]";
+                for(std::string const&e : extra)
+                    std::cerr << " [--" << e << "=...]";
+                std::cerr << "\n";
+                std::exit(1);
+            }
+        }
+    }
+    
+    // Parses a comma separated list of numbers, as given to options
+    inline std::vector<size_t> parse_list(std::string const&s)
+    {
+        std::vector<size_t> values;
+        for(size_t b = 0; b < s.size(); b = s.find(',', b) + 1) {
+            values.push_back(std::strtoull(s.c_str() + b, nullptr, 10));
+            if(s.find(',', b) == std::string::npos)
+                break;
+        }
+        
+        return values;
+    }
+    
+    // Keeps the compiler from optimizing away the computation of value
+    template<typename T>
+    void do_not_optimize(T const&value) {
+        asm volatile("" : : "r,m"(value) : "memory");
+    }
+    
+    struct result
+    {
+        std::string name;
+        
+        // Operations performed by each repetition
+        size_t ops;
+        
+        // Bytes processed by each repetition, or 0 if not meaningful
+        size_t bytes;
+        
+        // Nanoseconds per operation of each repetition, sorted
+        std::vector<double> samples;
+        
+        // Mean hardware counts per operation, negative if not measured
+        perf_counters::values counters;
+        
+        // Nearest-rank percentile, p in [0, 100]
+        double percentile(double p) const {
+            size_t rank = size_t(std::ceil(p / 100 * samples.size()));
+            return samples[std::min(std::max<size_t>(rank, 1),
+                                    samples.size()) - 1];
+        }
+        
+        double mean() const {
+            return std::accumulate(samples.begin(), samples.end(), 0.0) /
+                   samples.size();
+        }
+        
+        // GB/s at the median time, i.e. bytes per nanosecond
+        double throughput() const {
+            return double(bytes) / ops / percentile(50);
+        }
+    };
+    
+    /*
+     * Runs a benchmark. setup() returns the state passed to body(), which
+     * has to perform 'ops' operations.
+     */
+    template<typename Setup, typename Body>
+    result measure(options const&opts, std::string const&name, size_t ops,
+                   Setup setup, Body body)
+    {
+        using clock = std::chrono::steady_clock;
+        
+        result r = { name, ops, 0, { }, { } };
+        r.counters.fill(0);
+        
+        perf_counters perf(opts.counters);
+        
+        for(size_t i = 0; i < opts.warmup + opts.reps; ++i)
+        {
+            auto state = setup();
+            
+            perf.start();
+            auto begin = clock::now();
+            body(state);
+            auto end = clock::now();
+            perf.stop();
+            
+            do_not_optimize(state);
+            
+            if(i < opts.warmup)
+                continue;
+            
+            std::chrono::duration<double, std::nano> elapsed = end - begin;
+            r.samples.push_back(elapsed.count() / std::max<size_t>(ops, 1));
+            
+            perf_counters::values counts = perf.read();
+            for(size_t c = 0; c < perf_counters::count; ++c)
+                r.counters[c] = counts[c] < 0 || r.counters[c] < 0
+                              ? -1 : r.counters[c] + counts[c];
+        }
+        
+        for(double &c : r.counters)
+            if(c >= 0)
+                c /= double(std::max<size_t>(ops, 1)) * r.samples.size();
+        
+        std::sort(r.samples.begin(), r.samples.end());
+        
+        return r;
+    }
+    
+    /*
+     * Runs a latency benchmark. body() receives the state returned by
+     * setup() and a recorder with the given kinds of operations, and times
+     * each operation with the recorder's time() method. The warmup
+     * repetitions aren't recorded.
+     */
+    template<typename Setup, typename Body>
+    latency_recorder measure_latency(options const&opts,
+                                     std::vector<std::string> const&kinds,
+                                     Setup setup, Body body)
+    {
+        latency_recorder latencies(kinds);
+        
+        for(size_t i = 0; i < opts.warmup + opts.reps; ++i)
+        {
+            auto state = setup();
+            
+            latencies.enabled = i >= opts.warmup;
+            body(state, latencies);
+            
+            do_not_optimize(state);
+        }
+        
+        return latencies;
+    }
+    
+    // Prints the results in the requested format
+    class reporter
+    {
+    public:
+        explicit reporter(options const&opts, std::ostream &out = std::cout)
+            : _format(opts.format), _counters(opts.counters), _out(out) { }
+        
+        ~reporter() {
+            if(_format == "json")
+                _out << (_count == 0 ? "[" : "\n") << "]\n";
+        }
+        
+        void report(result const&r);
+        
+        // Reports the latencies of an operation, in nanoseconds
+        void report(std::string const&name, latency_histogram const&h);
+    
+    private:
+        // Tells if the header of this kind of rows has to be printed,
+        // i.e. if the previous row was of a different kind
+        bool header(bool latency) {
+            bool changed = _count == 0 || _latency != latency;
+            _latency = latency;
+            return changed;
+        }
+    
+    private:
+        std::string _format;
+        bool _counters;
+        std::ostream &_out;
+        size_t _count = 0;
+        bool _latency = false;
+    };
+    
+    // Runs the benchmarks selected by the options, reporting the results
+    class suite
+    {
+    public:
+        suite(int argc, char **argv,
+              std::vector<std::string> const&extra = { })
+            : _opts(argc, argv, extra), _reporter(_opts)
+        {
+            perf_counters perf(_opts.counters);
+            if(!perf.error().empty())
+                std::cerr << "Some hardware counters are unavailable ("
+                          << perf.error() << ")\n";
+        }
+        
+        options const&opts() const { return _opts; }
+        
+        template<typename Setup, typename Body>
+        void run(std::string const&name, size_t ops, Setup setup, Body body)
+        {
+            run(name, ops, 0, setup, body);
+        }
+        
+        template<typename Setup, typename Body>
+        void run(std::string const&name, size_t ops, size_t bytes,
+                 Setup setup, Body body)
+        {
+            if(!_opts.selected(name))
+                return;
+            
+            result r = measure(_opts, name, ops, setup, body);
+            r.bytes = bytes;
+            _reporter.report(r);
+        }
+        
+        // Runs a latency benchmark, reporting each kind of operation as
+        // name/kind, if any was performed
+        template<typename Setup, typename Body>
+        void run_latency(std::string const&name,
+                         std::vector<std::string> const&kinds,
+                         Setup setup, Body body)
+        {
+            if(!_opts.selected(name))
+                return;
+            
+            latency_recorder latencies =
+                measure_latency(_opts, kinds, setup, body);
+            for(size_t k = 0; k < kinds.size(); ++k)
+                if(latencies.histogram(k).count() > 0)
+                    _reporter.report(name + "/" + kinds[k],
+                                     latencies.histogram(k));
+        }
+    
+    private:
+        options _opts;
+        reporter _reporter;
+    };
+    
+    inline void reporter::report(result const&r)
+    {
+        const double stats[] = {
+            r.samples.front(), r.percentile(50), r.percentile(90),
+            r.percentile(99), r.samples.back(), r.mean()
+        };
+        const char *names[] = { "min", "p50", "p90", "p99", "max", "mean" };
+        
+        if(_format == "csv") {
+            if(header(false)) {
+                _out << "name,ops,reps,min_ns,p50_ns,p90_ns,p99_ns,max_ns,"
+                        "mean_ns,gb_per_s";
+                for(size_t c = 0; _counters && c < perf_counters::count; ++c)
+                    _out << "," << perf_counters::name(c);
+                _out << "\n";
+            }
+            
+            _out << r.name << "," << r.ops << "," << r.samples.size();
+            for(double s : stats)
+                _out << "," << s;
+            _out << ",";
+            if(r.bytes)
+                _out << r.throughput();
+            for(size_t c = 0; _counters && c < perf_counters::count; ++c) {
+                _out << ",";
+                if(r.counters[c] >= 0)
+                    _out << r.counters[c];
+            }
+            _out << "\n";
+        } else if(_format == "json") {
+            _out << (_count == 0 ? "[\n" : ",\n")
+                 << "  { \"name\": \"" << r.name << "\", \"ops\": " << r.ops
+                 << ", \"reps\": " << r.samples.size();
+            for(size_t i = 0; i < 6; ++i)
+                _out << ", \"" << names[i] << "_ns\": " << stats[i];
+            if(r.bytes)
+                _out << ", \"gb_per_s\": " << r.throughput();
+            for(size_t c = 0; _counters && c < perf_counters::count; ++c)
+                if(r.counters[c] >= 0)
+                    _out << ", \"" << perf_counters::name(c) << "\": "
+                         << r.counters[c];
+            _out << " }";
+        } else {
+            if(header(false)) {
+                _out << (_count == 0 ? "" : "\n")
+                     << std::left << std::setw(40) << "benchmark"
+                     << std::right << std::setw(10) << "ops";
+                for(char const*n : names)
+                    _out << std::setw(10) << n;
+                _out << std::setw(10) << "GB/s";
+                for(size_t c = 0; _counters && c < perf_counters::count; ++c)
+                    _out << std::setw(15) << perf_counters::name(c);
+                _out << "   (ns/op)\n";
+            }
+            
+            _out << std::left << std::setw(40) << r.name
+                 << std::right << std::setw(10) << r.ops
+                 << std::fixed << std::setprecision(2);
+            for(double s : stats)
+                _out << std::setw(10) << s;
+            if(r.bytes)
+                _out << std::setw(10) << r.throughput();
+            else
+                _out << std::setw(10) << "-";
+            for(size_t c = 0; _counters && c < perf_counters::count; ++c) {
+                if(r.counters[c] < 0)
+                    _out << std::setw(15) << "-";
+                else
+                    _out << std::setw(15) << r.counters[c];
+            }
+            _out << "\n";
+            _out.unsetf(std::ios::fixed);
+        }
+        
+        _out.flush();
+        ++_count;
+    }
+    
+    inline void reporter::report(std::string const&name,
+                                 latency_histogram const&h)
+    {
+        const double stats[] = {
+            h.percentile(50), h.percentile(99), h.percentile(99.9),
+            h.max(), h.mean()
+        };
+        const char *names[] = { "p50", "p99", "p99.9", "max", "mean" };
+        const char *keys[] = { "p50", "p99", "p999", "max", "mean" };
+        
+        if(_format == "csv") {
+            if(header(true)) {
+                _out << "name,count";
+                for(char const*k : keys)
+                    _out << "," << k << "_ns";
+                _out << "\n";
+            }
+            
+            _out << name << "," << h.count();
+            for(double s : stats)
+                _out << "," << s;
+            _out << "\n";
+        } else if(_format == "json") {
+            _out << (_count == 0 ? "[\n" : ",\n")
+                 << "  { \"name\": \"" << name << "\", \"count\": "
+                 << h.count();
+            for(size_t i = 0; i < 5; ++i)
+                _out << ", \"" << keys[i] << "_ns\": " << stats[i];
+            _out << " }";
+        } else {
+            if(header(true)) {
+                _out << (_count == 0 ? "" : "\n")
+                     << std::left << std::setw(40) << "latency"
+                     << std::right << std::setw(10) << "count";
+                for(char const*n : names)
+                    _out << std::setw(12) << n;
+                _out << "   (ns)\n";
+            }
+            
+            _out << std::left << std::setw(40) << name
+                 << std::right << std::setw(10) << h.count()
+                 << std::fixed << std::setprecision(1);
+            for(double s : stats)
+                _out << std::setw(12) << s;
+            _out << "\n";
+            _out.unsetf(std::ios::fixed);
+        }
+        
+        _out.flush();
+        ++_count;
+    }
+
+} // namespace bench
+
+#endif
@@ -0,0 +1,241 @@
+/*
+ * Copyright 2014 Nicola Gigante
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Tests of the statistics, the traces and the heatmap of bitvector_t.
+ * They change the layout of the bitvector, so they're built as a program
+ * of their own, while main.cpp tests the default configuration.
+ */
+#define PACKED_BITVECTOR_STATS
+#define PACKED_BITVECTOR_TRACE
+#define PACKED_BITVECTOR_HEATMAP
+
+#include "bitvector.h"
+#include "trace.h"
+
+#include <vector>
+#include <random>
+#include <numeric>
+#include <string>
+#include <sstream>
+
+using namespace bv;
+
+void test_bitvector_stats();
+void test_bitvector_trace();
+void test_trace_reader();
+void test_bitvector_heatmap();
+
+// Statistics agree with the shape of the tree
+void test_bitvector_stats()
+{
+    const size_t N = 100000;
+    
+    std::mt19937_64 engine(N);
+    bitvector_t<512> v(N, 128);
+    
+    for(size_t i = 0; i < N; ++i)
+        v.insert(engine() % (i + 1), engine() % 2);
+    
+    auto stats = v.stats();
+    
+    assert(stats.enabled);
+    assert(stats.root_splits == v.info().height - 1);
+    assert(stats.leaf_allocations == v.info().leaves);
+    assert(stats.node_allocations == v.info().nodes);
+    assert(stats.splits > 0 &&
+           stats.splits < stats.leaf_allocations + stats.node_allocations);
+    assert(stats.leaf_redistributions > stats.splits / 2);
+    assert(stats.node_redistributions > 0);
+    assert(stats.bits_moved >= stats.leaf_redistributions * v.info().buffer);
+    assert(stats.keys_moved > 0);
+    assert(stats.buffer_bytes >= stats.bits_moved / 8);
+    
+    v.reset_stats();
+    stats = v.stats();
+    assert(stats.splits == 0 && stats.bits_moved == 0);
+}
+
+// A trace gives back the recorded operations, and replaying it from its
+// initial bits gives the same bitvector
+void test_bitvector_trace()
+{
+    const size_t N = 10000;
+    
+    std::mt19937_64 engine(N);
+    bitvector_t<512> v(N, 128);
+    for(size_t i = 0; i < 100; ++i)
+        v.push_back(i % 3 == 0);
+    
+    std::stringstream trace;
+    bool enabled = v.trace(&trace);
+    assert(enabled);
+    internal::unused(enabled);
+    
+    auto apply = [](bitvector_t<512> &b, trace_record const&r) -> size_t {
+        switch(r.op) {
+            case trace_op::access: return b.access(r.index);
+            case trace_op::rank:   return b.rank(r.index, r.bit);
+            case trace_op::set:    b.set(r.index, r.bit);    return 0;
+            case trace_op::insert: b.insert(r.index, r.bit); return 0;
+        }
+        return 0;
+    };
+    
+    std::vector<trace_record> ops;
+    size_t sum = 0;
+    for(size_t k = 0; k < 2 * N; ++k)
+    {
+        trace_record r = { trace_op(engine() % 4), 0, bool(engine() % 2) };
+        if(r.op == trace_op::insert && v.full())
+            r.op = trace_op::set;
+        
+        r.index = engine() % (v.size() + (r.op == trace_op::insert));
+        sum += apply(v, r);
+        ops.push_back(r);
+        
+        // Copies don't write to the trace
+        if(k == N) {
+            bitvector_t<512> copy = v;
+            copy.set(0, true);
+        }
+    }
+    
+    v.trace(nullptr);
+    v.set(0, true);
+    
+    trace_reader reader(trace);
+    assert(reader.valid());
+    assert(reader.header().capacity == N);
+    assert(reader.header().node_width == 128);
+    assert(reader.header().leaf_width == 512);
+    assert(reader.header().initial.size() == 100);
+    
+    bitvector_t<512> replayed(N, 128);
+    for(bool bit : reader.header().initial)
+        replayed.push_back(bit);
+    
+    size_t replayed_sum = 0;
+    trace_record r = trace_record();
+    for(size_t k = 0; k < ops.size(); ++k) {
+        bool read = reader.next(r);
+        assert(read && r.op == ops[k].op && r.index == ops[k].index);
+        assert(r.op == trace_op::access || r.bit == ops[k].bit);
+        internal::unused(read);
+        
+        replayed_sum += apply(replayed, r);
+    }
+    assert(!reader.next(r));
+    assert(replayed_sum == sum);
+    internal::unused(sum, replayed_sum);
+    
+    replayed.set(0, true);
+    assert(replayed.size() == v.size());
+    for(size_t i = 0; i < v.size(); ++i)
+        assert(replayed.access(i) == v.access(i));
+}
+
+// Corrupt headers, with more initial bits than the capacity or fewer than
+// announced, make the trace invalid without allocating them
+void test_trace_reader()
+{
+    auto header = [](uint64_t capacity, uint64_t size) {
+        std::string h = "BVTRACE1";
+        for(uint64_t w : { capacity, uint64_t(128), uint64_t(512), size })
+            for(size_t i = 0; i < 8; ++i)
+                h += char(w >> (8 * i));
+        return h;
+    };
+    
+    std::istringstream fits(header(100, 10) + "\xff\x01");
+    trace_reader reader(fits);
+    assert(reader.valid() && reader.header().initial.size() == 10);
+    assert(reader.header().initial[8] && !reader.header().initial[9]);
+    internal::unused(reader);
+    
+    std::istringstream too_many(header(100, uint64_t(1) << 62));
+    assert(!trace_reader(too_many).valid());
+    
+    std::istringstream truncated(header(uint64_t(1) << 63,
+                                        uint64_t(1) << 62) + "\xff");
+    assert(!trace_reader(truncated).valid());
+}
+
+// The heatmap samples one operation every period, and finds the leaves
+// where they land
+void test_bitvector_heatmap()
+{
+    const size_t N = 100000;
+    const size_t period = 16;
+    
+    std::mt19937_64 engine(N);
+    bitvector_t<512> v(N, 128);
+    v.reset_heatmap(period);
+    
+    for(size_t i = 0; i < N; ++i)
+        v.insert(engine() % (i + 1), engine() % 2);
+    
+    bitvector_t<512>::heatmap_t h = v.heatmap();
+    assert(h.enabled && h.period == period);
+    assert(h.samples == N / period);
+    assert(h.depths.size() == v.info().height + 1);
+    assert(std::accumulate(h.depths.begin(), h.depths.end(), size_t(0)) ==
+           h.samples);
+    assert(h.leaves.size() == v.report().level_nodes[0]);
+    
+    size_t bits = 0, writes = 0;
+    for(auto const&leaf : h.leaves) {
+        assert(leaf.reads == 0);
+        bits += leaf.bits;
+        writes += leaf.writes;
+    }
+    assert(bits == N && writes == h.samples);
+    
+    // Reads of the first half of the vector land on the leaves holding it,
+    // at the bottom of the tree
+    v.reset_heatmap(period);
+    for(size_t k = 0; k < N; ++k)
+        v.access(engine() % (N / 2));
+    
+    h = v.heatmap();
+    assert(h.samples == N / period);
+    assert(h.depths.back() == h.samples);
+    
+    size_t begin = 0, reads = 0;
+    for(auto const&leaf : h.leaves) {
+        assert(leaf.writes == 0);
+        assert(begin < N / 2 || leaf.reads == 0);
+        begin += leaf.bits;
+        reads += leaf.reads;
+    }
+    assert(reads == h.samples);
+    internal::unused(bits, writes, begin, reads);
+    
+    std::ostringstream dump;
+    h.dump(dump);
+    assert(dump.str().find("# leaf index bits reads writes") !=
+           std::string::npos);
+}
+
+int main()
+{
+    test_bitvector_stats();
+    test_bitvector_trace();
+    test_trace_reader();
+    test_bitvector_heatmap();
+    
+    return 0;
+}
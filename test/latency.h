@@ -0,0 +1,197 @@
+/*
+ * Copyright 2014 Nicola Gigante
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PACKED_BITVECTOR_LATENCY_H
+#define PACKED_BITVECTOR_LATENCY_H
+
+#include <array>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace bench
+{
+    /*
+     * Cheap timestamps for timing single operations. On x86 they're read
+     * from the time stamp counter, which runs at a constant rate on modern
+     * CPUs, and converted to nanoseconds with a rate measured once against
+     * steady_clock. Elsewhere they're steady_clock's nanoseconds.
+     */
+    struct cycle_clock
+    {
+        static uint64_t now() {
+#if defined(__x86_64__) || defined(__i386__)
+            return __rdtsc();
+#else
+            using namespace std::chrono;
+            return uint64_t(duration_cast<nanoseconds>(
+                steady_clock::now().time_since_epoch()).count());
+#endif
+        }
+        
+        static double ns_per_tick();
+    };
+    
+    inline double cycle_clock::ns_per_tick()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        static const double rate = [] {
+            using clock = std::chrono::steady_clock;
+            
+            auto begin = clock::now();
+            uint64_t ticks = now();
+            while(clock::now() - begin < std::chrono::milliseconds(20))
+                continue;
+            ticks = now() - ticks;
+            
+            std::chrono::duration<double, std::nano> elapsed =
+                clock::now() - begin;
+            return elapsed.count() / ticks;
+        }();
+        
+        return rate;
+#else
+        return 1;
+#endif
+    }
+    
+    /*
+     * Histogram of latencies, with logarithmic buckets as in HdrHistogram.
+     * Each power of two is split into 32 linear sub-buckets, so every
+     * value is known within 1/32 of it, whatever its magnitude, with a
+     * fixed amount of memory. The maximum and the mean are exact.
+     */
+    class latency_histogram
+    {
+    public:
+        static constexpr size_t sub_bits = 5;
+        static constexpr size_t sub_buckets = size_t(1) << sub_bits;
+        
+        void record(uint64_t ticks) {
+            _buckets[bucket(ticks)] += 1;
+            _count += 1;
+            _sum += ticks;
+            _max = std::max(_max, ticks);
+        }
+        
+        void merge(latency_histogram const&h) {
+            for(size_t i = 0; i < _buckets.size(); ++i)
+                _buckets[i] += h._buckets[i];
+            _count += h._count;
+            _sum += h._sum;
+            _max = std::max(_max, h._max);
+        }
+        
+        uint64_t count() const { return _count; }
+        
+        // Latencies in nanoseconds. Percentiles are the highest value of
+        // their bucket, p in [0, 100].
+        double percentile(double p) const;
+        double max() const { return _max * cycle_clock::ns_per_tick(); }
+        double mean() const {
+            return _count ? _sum * cycle_clock::ns_per_tick() / _count : 0;
+        }
+    
+    private:
+        static size_t bucket(uint64_t v) {
+            if(v < sub_buckets)
+                return size_t(v);
+            
+            size_t e = 63 - size_t(__builtin_clzll(v));
+            return (e - sub_bits + 1) * sub_buckets +
+                   size_t(v >> (e - sub_bits)) % sub_buckets;
+        }
+        
+        // Highest value falling in the i-th bucket
+        static uint64_t highest(size_t i) {
+            if(i < sub_buckets)
+                return i;
+            
+            size_t shift = i / sub_buckets - 1;
+            uint64_t lowest = uint64_t(sub_buckets + i % sub_buckets) << shift;
+            return lowest + ((uint64_t(1) << shift) - 1);
+        }
+    
+    private:
+        std::array<uint64_t, (64 - sub_bits + 1) * sub_buckets> _buckets{};
+        uint64_t _count = 0;
+        uint64_t _sum = 0;
+        uint64_t _max = 0;
+    };
+    
+    inline double latency_histogram::percentile(double p) const
+    {
+        if(_count == 0)
+            return 0;
+        
+        // Nearest rank, as for the times of the repetitions
+        uint64_t rank = std::max<uint64_t>(uint64_t(p / 100 * _count + 0.5), 1);
+        uint64_t seen = 0;
+        for(size_t i = 0; i < _buckets.size(); ++i) {
+            seen += _buckets[i];
+            if(seen >= rank)
+                return std::min(highest(i), _max) * cycle_clock::ns_per_tick();
+        }
+        
+        return max();
+    }
+    
+    /*
+     * Latencies of the operations of a benchmark, one histogram for each
+     * kind of operation. Timing is skipped when disabled, e.g. during the
+     * warmup.
+     */
+    class latency_recorder
+    {
+    public:
+        explicit latency_recorder(std::vector<std::string> kinds)
+            : _kinds(std::move(kinds)), _histograms(_kinds.size()) { }
+        
+        // Runs f(), timing it as an operation of the k-th kind
+        template<typename F>
+        void time(size_t k, F f) {
+            if(!enabled) {
+                f();
+                return;
+            }
+            
+            uint64_t begin = cycle_clock::now();
+            f();
+            _histograms[k].record(cycle_clock::now() - begin);
+        }
+        
+        std::vector<std::string> const&kinds() const { return _kinds; }
+        
+        latency_histogram const&histogram(size_t k) const {
+            return _histograms[k];
+        }
+        
+        bool enabled = true;
+    
+    private:
+        std::vector<std::string> _kinds;
+        std::vector<latency_histogram> _histograms;
+    };
+
+} // namespace bench
+
+#endif
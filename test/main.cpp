@@ -17,9 +17,21 @@
 #include "bitview.h"
 #include "packed_view.h"
 #include "bitvector.h"
+#include "rank_select_support.h"
+#include "buffer_view.h"
+#include "mmap_vector.h"
+#include "atomic_bitview.h"
+#include "atomic_packed_view.h"
 
 #include <vector>
+#include <deque>
 #include <array>
+#include <random>
+#include <cstdio>
+#include <thread>
+#include <numeric>
+#include <sstream>
+#include <stdexcept>
 
 #include <iostream>
 
@@ -27,22 +39,183 @@ using namespace bv;
 
 void test_bits();
 void test_word();
+void test_copy();
+void test_logic();
+void test_gather();
+void test_rank_select();
+void test_buffer_view();
+void test_mmap_vector();
+void test_atomic_bitview();
+void test_atomic_packed_view();
 void test_packed_view();
+void test_packed_arith();
+void test_packed_bulk();
+void test_packed_array();
+void test_packed_sort();
+void test_packed_repack();
 void test_bitvector();
+void test_bitvector_report();
+void test_bitvector_instrumentation();
+
+// Random insertions, pushes at both ends and sets, checked against a
+// vector<bool>, looking at the contents and the ranks
+template<size_t W>
+void test_bitvector(size_t N, size_t Wn)
+{
+    std::mt19937_64 engine(N + W);
+    bitvector_t<W> v(N, Wn);
+    std::vector<bool> ref;
+    
+    assert(v.empty());
+    
+    for(size_t i = 0; i < N; ++i) {
+        bool bit = engine() % 2;
+        
+        switch(engine() % 4) {
+            case 0:
+                v.push_back(bit);
+                ref.push_back(bit);
+                break;
+            case 1:
+                v.push_front(bit);
+                ref.insert(ref.begin(), bit);
+                break;
+            default:
+                size_t index = engine() % (i + 1);
+                v.insert(index, bit);
+                ref.insert(ref.begin() + index, bit);
+        }
+    }
+    
+    assert(v.full() && v.size() == N);
+    
+    for(size_t k = 0; k < N / 10; ++k) {
+        size_t index = engine() % N;
+        bool bit = engine() % 2;
+        
+        v[index] = bit;
+        ref[index] = bit;
+    }
+    
+    for(size_t i = 0, rank = 0; i < N; ++i) {
+        assert(v.access(i) == ref[i]);
+        assert(v.rank(i) == rank);
+        assert(v.rank(i, false) == i - rank);
+        rank += ref[i];
+    }
+}
 
 void test_bitvector()
 {
-    constexpr size_t W = 2048;
-    constexpr allocation_policy_t AP = alloc_on_demand;
-    size_t N = 1000000;
-    size_t Wn = 256;
+    test_bitvector<512>(1000, 256);
+    test_bitvector<2048>(10000, 256);
+    test_bitvector<2048>(10000, 64);
+    
+    // Nodes must hold the pointers to their children, unless there are none
+    assert(bitvector_t<512>::valid_node_width(512, 0));
+    assert(bitvector_t<512>::valid_node_width(100000, 128));
+    assert(!bitvector_t<512>::valid_node_width(100000, 48));
+    assert(!bitvector_t<512>::valid_node_width(100000000, 64));
+    
+    bool thrown = false;
+    try {
+        bitvector_t<512> v(100000, 48);
+    } catch(std::invalid_argument const&) {
+        thrown = true;
+    }
+    assert(thrown);
+    internal::unused(thrown);
+}
+
+// The report describes the whole tree and every buffer
+template<allocation_policy_t AP>
+void test_bitvector_report(size_t N)
+{
+    std::mt19937_64 engine(N);
+    bitvector_t<512, AP> v(N, 128);
+    
+    for(size_t i = 0; i < N / 2; ++i)
+        v.insert(engine() % (i + 1), engine() % 2);
+    
+    auto r = v.report();
+    
+    assert(r.level_nodes.size() == v.info().height + 1);
+    assert(r.level_nodes.back() == 1);
+    
+    size_t nodes = std::accumulate(r.level_nodes.begin() + 1,
+                                   r.level_nodes.end(), size_t(0));
+    size_t leaves = r.level_nodes[0];
+    assert(std::accumulate(r.leaf_fill.begin(), r.leaf_fill.end(),
+                           size_t(0)) == leaves);
+    
+    // Every node and leaf but the root is the child of a node
+    size_t parents = 0, children = 0;
+    for(size_t k = 0; k < r.children.size(); ++k) {
+        parents += r.children[k];
+        children += k * r.children[k];
+    }
+    assert(parents == nodes);
+    assert(children == nodes + leaves - 1);
+    
+    for(auto b : { r.sizes, r.ranks, r.pointers, r.leaves }) {
+        assert(b.used > 0 && b.used <= b.allocated);
+        assert(b.exact == (AP == alloc_immediatly));
+        internal::unused(b);
+    }
+    assert(r.bytes * 8 >= v.memory());
+    assert(r.exact == (AP == alloc_immediatly));
+    
+    // With alloc_on_demand the leaves in use are allocated, plus the
+    // sentinel, while alloc_immediatly reserves them all
+    if(AP == alloc_on_demand)
+        assert(v.info().leaves == leaves + 1);
+    else
+        assert(r.leaves.allocated > 2 * r.leaves.used);
+    
+    internal::unused(nodes, leaves);
+}
+
+void test_bitvector_report()
+{
+    test_bitvector_report<alloc_on_demand>(100000);
+    test_bitvector_report<alloc_immediatly>(100000);
+    
+    // A small bitvector is a single leaf, but it keeps its node width
+    bitvector_t<512> v(300, 128);
+    v.push_back(true);
+    assert(v.info().node_width == 128);
+    
+    auto r = v.report();
+    assert(r.level_nodes.size() == 1 && r.level_nodes[0] == 1);
+    assert(r.children.empty() && r.leaf_fill[0] == 1);
+    assert(r.sizes.used == 0 && r.leaves.used == 64);
+}
+
+// By default the statistics, the traces and the heatmap are compiled out
+// and record nothing. They are tested enabled in instrumented.cpp.
+void test_bitvector_instrumentation()
+{
+    const size_t N = 10000;
     
-    bitvector_t<W, AP>::test(std::cout, N, Wn,
-                             /*random      =*/true,
-                             /*testrank    =*/false,
-                             /*dumpinfo    =*/false,
-                             /*dumpnode    =*/false,
-                             /*dumpcontents=*/false);
+    bitvector_t<512> v(N, 128);
+    
+    std::ostringstream trace;
+    bool enabled = v.trace(&trace);
+    v.reset_heatmap(1);
+    
+    for(size_t i = 0; i < N; ++i)
+        v.push_back(i % 3 == 0);
+    
+    assert(!enabled && trace.str().empty());
+    
+    auto stats = v.stats();
+    assert(!stats.enabled);
+    assert(stats.leaf_allocations == 0 && stats.splits == 0);
+    
+    auto h = v.heatmap();
+    assert(!h.enabled && h.samples == 0);
+    assert(h.depths.empty() && h.leaves.empty());
+    internal::unused(enabled, stats, h);
 }
 
 void test_packed_view()
@@ -105,8 +278,275 @@ void test_packed_view()
     v[3] = 10;
     
     std::sort(v.begin(), v.end());
-    
+
     assert(std::is_sorted(v.begin(), v.end()));
+
+    // Test the broadword search functions, with fields using the flag bit too
+    packed_view<std::vector> s(12, 100);
+    for(size_t i = 0; i < s.size(); ++i)
+        s[i] = i * 40;
+
+    assert(s.find(0, s.size(), 400) == 10);
+    assert(s.find(0, s.size(), 401) == s.size());
+    assert(s.find(11, 50, 400) == 50);
+    assert(s.find(0, s.size(), 3960) == 99);
+
+    assert(s.count_less(0, s.size(), 0) == 0);
+    assert(s.count_less(0, s.size(), 401) == 11);
+    assert(s.count_less(5, 20, 401) == 6);
+    assert(s.count_less(0, s.size(), 4095) == s.size());
+
+    assert(s.lower_bound(0, s.size(), 400) == 10);
+    assert(s.lower_bound(0, s.size(), 401) == 11);
+    assert(s.lower_bound(0, s.size(), 4000) == s.size());
+    assert(s.lower_bound(20, 30, 0) == 20);
+}
+
+template<template<typename ...> class C, typename Word = uint64_t>
+void test_packed_arith(size_t width)
+{
+    const size_t N = 300;
+    const uint64_t max = bv::internal::lowbits(~uint64_t(0), width);
+    
+    std::mt19937 engine(width);
+    std::vector<uint64_t> ref(N), ref2(N);
+    packed_view<C, 0, Word> v(width, N), v2(width, N);
+    
+    for(size_t i = 0; i < N; ++i) {
+        v[i] = ref[i] = engine() % (max / 4 + 1);
+        v2[i] = ref2[i] = engine() % (max / 4 + 1);
+    }
+    
+    for(size_t k = 0; k < 50; ++k) {
+        size_t b = engine() % N;
+        size_t e = b + engine() % (N - b + 1);
+        uint64_t n = engine() % (max / 16 + 1);
+        
+        v(b, e) += n;
+        for(size_t i = b; i < e; ++i)
+            ref[i] += n;
+        
+        v(b, e) -= n / 2;
+        for(size_t i = b; i < e; ++i)
+            ref[i] -= n / 2;
+    }
+    
+    for(size_t i = 0; i < N; ++i)
+        assert(v[i] == ref[i]);
+    
+    // Element-wise sum between ranges with different alignments
+    for(size_t k = 0; k < 20; ++k) {
+        size_t len = engine() % (N / 2);
+        size_t sb = engine() % (N - len + 1);
+        size_t db = engine() % (N - len + 1);
+        
+        v(db, db + len) += v2(sb, sb + len);
+        for(size_t i = 0; i < len; ++i)
+            ref[db + i] += ref2[sb + i];
+        
+        v(db, db + len) -= v2(sb, sb + len);
+        for(size_t i = 0; i < len; ++i)
+            ref[db + i] -= ref2[sb + i];
+    }
+    
+    for(size_t i = 0; i < N; ++i)
+        assert(v[i] == ref[i]);
+    
+    // Prefix sum of small values, over a range short enough for the sums
+    // to fit into the fields, as prefix_sum() requires
+    for(size_t i = 0; i < N; ++i)
+        v[i] = ref[i] = engine() % 2;
+    
+    const size_t end = size_t(std::min<uint64_t>(N - 3, 7 + max));
+    v.prefix_sum(7, end);
+    for(size_t i = 8; i < end; ++i)
+        ref[i] += ref[i - 1];
+    
+    for(size_t i = 0; i < N; ++i)
+        assert(v[i] == ref[i]);
+}
+
+void test_packed_arith()
+{
+    for(size_t width : { 3, 9, 12, 16, 22, 32, 40, 64 }) {
+        test_packed_arith<std::vector>(width);
+        test_packed_arith<std::deque>(width);
+        if(width <= 32)
+            test_packed_arith<std::vector, uint32_t>(width);
+#if defined(__SIZEOF_INT128__)
+        test_packed_arith<std::vector, bv::internal::uint128_t>(width);
+#endif
+    }
+}
+
+template<template<typename ...> class C, typename T, typename Word = uint64_t>
+void test_packed_bulk(size_t width)
+{
+    const size_t N = 1000;
+    
+    std::mt19937_64 engine(width);
+    std::vector<T> in(N), out(N);
+    for(T &x : in)
+        x = T(bv::internal::lowbits(uint64_t(engine()), width));
+    
+    packed_view<C, 0, Word> v(width, N + 10);
+    v(0, v.size()) = 0;
+    
+    for(size_t b : { 0, 1, 7, 64 }) {
+        size_t n = N - b;
+        
+        v.pack(in.data(), n, b);
+        for(size_t i = 0; i < n; ++i)
+            assert(v[b + i] == in[i]);
+        
+        v.unpack(b, b + n, out.data());
+        assert(std::equal(out.begin(), out.begin() + n, in.begin()));
+    }
+    
+    // Fields around the packed range are not touched
+    v.set(0, 5, 1);
+    v.set(N + 5, N + 10, 1);
+    v.pack(in.data(), N, 5);
+    assert(v[4] == 1 && v[N + 5] == 1);
+}
+
+void test_packed_bulk()
+{
+    for(size_t width = 1; width <= 64; ++width) {
+        test_packed_bulk<std::vector, uint64_t>(width);
+        test_packed_bulk<std::deque, uint64_t>(width);
+        if(width <= 32) {
+            test_packed_bulk<std::vector, uint32_t>(width);
+            test_packed_bulk<std::deque, uint32_t>(width);
+            test_packed_bulk<std::vector, uint32_t, uint32_t>(width);
+            test_packed_bulk<std::vector, uint64_t, uint32_t>(width);
+        }
+#if defined(__SIZEOF_INT128__)
+        test_packed_bulk<std::vector, uint64_t, bv::internal::uint128_t>(width);
+#endif
+    }
+}
+
+template<size_t Width>
+void test_packed_array()
+{
+    const size_t N = 200;
+    
+    packed_array<Width, std::vector> a(N);
+    packed_view<std::vector> v(Width, N);
+    
+    static_assert(sizeof(a) < sizeof(v), "The width must take no space");
+    assert(a.size() == N && a.capacity() >= N);
+    
+    std::mt19937 engine(Width);
+    for(size_t i = 0; i < N; ++i)
+        a[i] = v[i] = engine() % (uint64_t(1) << (Width - 2));
+    
+    a(10, 150) += 1;
+    v(10, 150) += 1;
+    a(0, 50) += a(100, 150);
+    v(0, 50) += v(100, 150);
+    
+    for(size_t i = 0; i < N; ++i)
+        assert(a[i] == v[i]);
+    
+    assert(a.count_less(0, N, 3) == v.count_less(0, N, 3));
+    assert(to_binary(a(0, N)) == to_binary(v(0, N)));
+    
+    // Copy between arrays and views of different kinds
+    packed_array<Width, std::deque> d(N);
+    d(0, N) = v(0, N);
+    for(size_t i = 0; i < N; ++i)
+        assert(d[i] == v[i]);
+}
+
+void test_packed_array()
+{
+    test_packed_array<4>();
+    test_packed_array<8>();
+    test_packed_array<13>();
+    test_packed_array<20>();
+    test_packed_array<32>();
+}
+
+template<template<typename ...> class C, typename Word = uint64_t>
+void test_packed_sort(size_t width, size_t N)
+{
+    std::mt19937_64 engine(width);
+    std::vector<uint64_t> ref(N);
+    packed_view<C, 0, Word> v(width, N);
+    
+    for(size_t i = 0; i < N; ++i)
+        v[i] = ref[i] = bv::internal::lowbits(uint64_t(engine()), width);
+    
+    // Sort a range leaving the borders in place
+    v.sort(3, N - 3);
+    std::sort(ref.begin() + 3, ref.end() - 3);
+    
+    for(size_t i = 0; i < N; ++i)
+        assert(v[i] == ref[i]);
+    
+    uint64_t sum = 0;
+    v.for_each(0, N, [&](uint64_t x) { sum += x % 1000; });
+    
+    uint64_t refsum = 0;
+    for(uint64_t x : ref)
+        refsum += x % 1000;
+    assert(sum == refsum);
+    
+    v.transform(1, N, [](uint64_t x) { return x / 2; });
+    assert(v[0] == ref[0]);
+    for(size_t i = 1; i < N; ++i)
+        assert(v[i] == ref[i] / 2);
+}
+
+void test_packed_sort()
+{
+    for(size_t width : { 1, 7, 20, 33, 64 }) {
+        test_packed_sort<std::vector>(width, 100);
+        test_packed_sort<std::vector>(width, 5000);
+        test_packed_sort<std::deque>(width, 5000);
+        if(width <= 32)
+            test_packed_sort<std::vector, uint32_t>(width, 5000);
+#if defined(__SIZEOF_INT128__)
+        test_packed_sort<std::vector, bv::internal::uint128_t>(width, 5000);
+#endif
+    }
+}
+
+// Grows the fields and shrinks them back, checking the values each time
+template<template<typename ...> class C, typename Word = uint64_t>
+void test_packed_repack(size_t width, size_t wider, size_t N)
+{
+    std::mt19937_64 engine(width * N);
+    std::vector<Word> ref(N);
+    packed_view<C, 0, Word> v(width, N);
+    
+    for(size_t i = 0; i < N; ++i)
+        v[i] = ref[i] = bv::internal::lowbits(Word(engine()), width);
+    
+    v.repack(wider);
+    assert(v.width() == wider && v.size() == N);
+    for(size_t i = 0; i < N; ++i)
+        assert(v[i] == ref[i]);
+    
+    v.repack(width + 1);
+    v.repack(width);
+    assert(v.bits().size() < width * N + bv::internal::bitsize<Word>());
+    for(size_t i = 0; i < N; ++i)
+        assert(v[i] == ref[i]);
+}
+
+void test_packed_repack()
+{
+    for(size_t width : { 1, 7, 12, 31, 40 }) {
+        size_t widths[] = { width + 1, std::min<size_t>(2 * width, 64), 64 };
+        for(size_t wider : widths) {
+            test_packed_repack<std::vector>(width, wider, 1000);
+            test_packed_repack<std::deque>(width, wider, 700);
+        }
+        test_packed_repack<std::vector, uint32_t>(width % 32, 32, 1000);
+    }
 }
 
 void test_word()
@@ -156,6 +596,390 @@ void test_word()
     assert(w.popcount(60, 70) == 4);
 }
 
+// Random copies, also overlapping ones inside the same view,
+// checked against a vector<bool>
+template<template<typename ...> class C1, template<typename ...> class C2,
+         typename Word = uint64_t>
+void test_copy(size_t bits)
+{
+    std::mt19937_64 engine(bits);
+    const size_t w = bv::internal::bitsize<Word>();
+    bitview<C1, Word> v(bits);
+    bitview<C2, Word> src(bits);
+    std::vector<bool> ref(bits), refsrc(bits);
+    
+    for(size_t i = 0; i < bits; ++i) {
+        v.set(i, ref[i] = engine() % 2);
+        src.set(i, refsrc[i] = engine() % 2);
+    }
+    
+    for(size_t k = 0; k < 200; ++k) {
+        size_t len = engine() % (bits / 2);
+        size_t sb = engine() % (bits - len + 1);
+        size_t db = engine() % (bits - len + 1);
+        
+        // Same offset in the words, where the copy is a plain move
+        if(k % 4 == 0)
+            db = sb % w + engine() % ((bits - len - sb % w) / w + 1) * w;
+        
+        if(k % 2) {
+            v.copy(v, sb, sb + len, db, db + len);
+            std::vector<bool> tmp(ref.begin() + sb, ref.begin() + sb + len);
+            std::copy(tmp.begin(), tmp.end(), ref.begin() + db);
+        } else {
+            v.copy(src, sb, sb + len, db, db + len);
+            std::copy(refsrc.begin() + sb, refsrc.begin() + sb + len,
+                      ref.begin() + db);
+        }
+    }
+    
+    for(size_t i = 0; i < bits; ++i)
+        assert(v.get(i) == ref[i]);
+}
+
+void test_copy()
+{
+    for(size_t bits : { 64, 640, 2048 + 64 }) {
+        test_copy<std::vector, std::vector>(bits);
+        test_copy<std::vector, std::deque>(bits);
+        test_copy<std::deque, std::deque>(bits);
+        test_copy<std::vector, std::deque, uint32_t>(bits);
+#if defined(__SIZEOF_INT128__)
+        test_copy<std::vector, std::vector, bv::internal::uint128_t>(bits);
+#endif
+    }
+}
+
+template<template<typename ...> class C1, template<typename ...> class C2,
+         typename Word = uint64_t>
+void test_logic(size_t bits)
+{
+    std::mt19937_64 engine(bits);
+    const size_t w = bv::internal::bitsize<Word>();
+    bitview<C1, Word> v(bits);
+    bitview<C2, Word> src(bits);
+    std::vector<bool> ref(bits), refsrc(bits);
+    
+    for(size_t i = 0; i < bits; ++i) {
+        v.set(i, ref[i] = engine() % 2);
+        src.set(i, refsrc[i] = engine() % 2);
+    }
+    
+    for(size_t k = 0; k < 200; ++k) {
+        size_t len = engine() % (bits / 2);
+        size_t sb = engine() % (bits - len + 1);
+        size_t db = engine() % (bits - len + 1);
+        
+        if(k % 3 == 0)
+            db = sb % w + engine() % ((bits - len - sb % w) / w + 1) * w;
+        
+        size_t count = 0;
+        for(size_t i = 0; i < len; ++i)
+            count += ref[db + i] && refsrc[sb + i];
+        assert(v.popcount_and(src, sb, sb + len, db, db + len) == count);
+        
+        switch(k % 5) {
+            case 0: v(db, db + len) &= src(sb, sb + len); break;
+            case 1: v(db, db + len) |= src(sb, sb + len); break;
+            case 2: v(db, db + len) ^= src(sb, sb + len); break;
+            case 3: v.andnot_with(src, sb, sb + len, db, db + len); break;
+            case 4: v.flip(db, db + len); break;
+        }
+        
+        for(size_t i = 0; i < len; ++i) {
+            bool a = ref[db + i], b = refsrc[sb + i];
+            bool results[] = { a && b, a || b, a != b, a && !b, !a };
+            ref[db + i] = results[k % 5];
+        }
+    }
+    
+    for(size_t i = 0; i < bits; ++i)
+        assert(v.get(i) == ref[i]);
+}
+
+void test_logic()
+{
+    for(size_t bits : { 64, 640, 2048 + 64 }) {
+        test_logic<std::vector, std::vector>(bits);
+        test_logic<std::vector, std::deque>(bits);
+        test_logic<std::deque, std::deque>(bits);
+        test_logic<std::vector, std::deque, uint32_t>(bits);
+#if defined(__SIZEOF_INT128__)
+        test_logic<std::vector, std::vector, bv::internal::uint128_t>(bits);
+#endif
+    }
+}
+
+// Ranges at random positions, also reaching the end of the view,
+// gathered and scattered, checked against get() and set()
+template<template<typename ...> class C, typename Word = uint64_t>
+void test_gather(size_t bits, size_t len)
+{
+    std::mt19937_64 engine(bits + len);
+    const size_t n = 1000;
+    
+    bitview<C, Word> v(bits), ref(bits);
+    for(size_t i = 0; i < bits; ++i)
+        v.set(i, engine() % 2);
+    
+    std::vector<size_t> begins(n);
+    for(size_t &b : begins)
+        b = engine() % (bits - len + 1);
+    begins[n / 2] = bits - len;
+    
+    std::vector<Word> out(n);
+    v.gather(begins.data(), len, out.data(), n);
+    for(size_t i = 0; i < n; ++i)
+        assert(out[i] == v.get(begins[i], begins[i] + len));
+    
+    for(size_t i = 0; i < n; ++i) {
+        out[i] = bv::internal::lowbits(Word(engine()), len);
+        ref.set(begins[i], begins[i] + len, out[i]);
+    }
+    v.clear();
+    v.scatter(begins.data(), len, out.data(), n);
+    
+    for(size_t i = 0; i < bits; ++i)
+        assert(v.get(i) == ref.get(i));
+}
+
+void test_gather()
+{
+    for(size_t len : { 0, 1, 13, 31, 32, 57, 64 }) {
+        test_gather<std::vector>(64, len);
+        test_gather<std::vector>(64 * 1000, len);
+        test_gather<std::deque>(64 * 100, len);
+        if(len <= 32)
+            test_gather<std::vector, uint32_t>(64 * 100, len);
+    }
+}
+
+void test_rank_select(size_t words, size_t density, size_t threads)
+{
+    std::mt19937_64 engine(words * density);
+    bitview<std::vector> v(words * 64);
+    
+    for(size_t i = 0; i < v.size(); ++i)
+        v.set(i, engine() % 100 < density);
+    
+    rank_select_support<std::vector> rs(v, threads);
+    
+    assert(rs.count() == v.popcount());
+    
+    for(size_t i = 0, rank = 0; i <= v.size(); ++i) {
+        assert(rs.rank(i) == rank);
+        
+        if(i < v.size() && v.get(i)) {
+            assert(rs.select(rank) == i);
+            ++rank;
+        }
+    }
+}
+
+void test_rank_select()
+{
+    for(size_t density : { 0, 1, 50, 100 }) {
+        test_rank_select(1, density, 1);
+        test_rank_select(13, density, 1);
+        test_rank_select(8 * 3000 + 5, density, 1);
+        test_rank_select(8 * 3000 + 5, density, 3);
+    }
+}
+
+// Views working in place on words owned by someone else
+void test_buffer_view()
+{
+    uint64_t words[40] = { };
+    
+    bitview<buffer_view> v(buffer_view<uint64_t>(words, 40));
+    assert(v.size() == 40 * 64);
+    assert(v.data() == words);
+    
+    v.set(60, 70, 169);
+    assert(words[0] >> 60 == (169 & 0xF) && words[1] == 169 >> 4);
+    
+    bitview<std::vector> src(40 * 64);
+    for(size_t i = 0; i < src.size(); ++i)
+        src.set(i, i % 3 == 0);
+    
+    v.copy(src, 5, 2000, 7, 2002);
+    for(size_t i = 0; i < 1995; ++i)
+        assert(v.get(7 + i) == src.get(5 + i));
+    
+    v(0, v.size()) ^= src(0, src.size());
+    for(size_t i = 7; i < 2002; ++i)
+        assert(v.get(i) == (src.get(i - 2) != src.get(i)));
+    
+    packed_view<buffer_view> p(10, 256, buffer_view<uint64_t>(words, 40));
+    for(size_t i = 0; i < p.size(); ++i)
+        p[i] = i * 3;
+    assert(p.find(0, p.size(), 300) == 100);
+    assert(bv::internal::bitfield(words[0], 10, 20) == 3);
+    
+    // Read-only views over the same words
+    uint64_t const*cwords = words;
+    packed_array<10, const_buffer_view> cp(256, { cwords, 40 });
+    assert(cp[255] == 765);
+    assert(cp.count_less(0, cp.size(), 30) == 10);
+    
+    bitview<const_buffer_view> cv(buffer_view<uint64_t>(words, 40));
+    rank_select_support<const_buffer_view> rs(cv);
+    assert(rs.count() == cv.popcount());
+    size_t rank = 0;
+    for(size_t i = 0; i < cv.size(); ++i) {
+        assert(rs.rank(i) == rank);
+        if(cv.get(i)) {
+            assert(rs.select(rank) == i);
+            ++rank;
+        }
+    }
+    assert(rank == rs.count());
+}
+
+// Views over anonymous and file-backed mappings, which persist the data
+void test_mmap_vector()
+{
+    const char *path = "test-mmap_vector.tmp";
+    std::remove(path);
+    
+    bitview<mmap_vector> a(1000);
+    assert(a.popcount() == 0);
+    a.set(500, true);
+    assert(a.get(500));
+    
+    {
+        packed_view<mmap_vector> p(12, 0, mmap_vector<uint64_t>(path, 0));
+        p.container().advise(mmap_vector<uint64_t>::advice::sequential);
+        
+        // Grows across several remaps
+        for(size_t n = 1000; n <= 1000000; n *= 10) {
+            size_t old = p.size();
+            p.resize(n);
+            for(size_t i = old; i < n; ++i) {
+                assert(p[i] == 0);
+                if(i % 997 == 0)
+                    p[i] = i % 4096;
+            }
+        }
+        
+        p.container().sync();
+    }
+    
+    packed_view<mmap_vector> p(12, 1000000, mmap_vector<uint64_t>(path));
+    assert(p.container().file_backed());
+    assert(p.container().size() == 1000000 * 12 / 64);
+    for(size_t i = 0; i < p.size(); ++i)
+        assert(p[i] == (i % 997 == 0 ? i % 4096 : 0));
+    
+    std::remove(path);
+}
+
+// Threads racing to mark the same bits, like in a parallel traversal.
+// Each bit must be won by exactly one thread.
+void test_atomic_bitview()
+{
+    const size_t bits = 100000;
+    const size_t nthreads = 4;
+    
+    bitview<std::vector> v(bits);
+    atomic_bitview<std::vector> av(v);
+    
+    std::vector<size_t> won(nthreads);
+    std::vector<std::thread> threads;
+    for(size_t t = 0; t < nthreads; ++t)
+        threads.emplace_back([&, t] {
+            std::mt19937_64 engine(t);
+            for(size_t k = 0; k < bits; ++k) {
+                size_t i = engine() % bits;
+                if(i % 3 != 0 && !av.test_and_set(i, std::memory_order_relaxed))
+                    ++won[t];
+            }
+        });
+    
+    for(std::thread &t : threads)
+        t.join();
+    
+    size_t total = 0;
+    for(size_t w : won)
+        total += w;
+    
+    assert(av.popcount() == total);
+    assert(v.popcount() == total);
+    assert(av.popcount(100, 9000) == v.popcount(100, 9000));
+    
+    for(size_t i = 0; i < bits; i += 3)
+        assert(!av.test(i));
+    
+    av.set(3);
+    assert(av.test_and_reset(3) && !av.test_and_reset(3) && !v.get(3));
+    
+    av.fetch_and(0, 0);
+    assert(av.fetch_or(0, 0xF0) == 0 && av.load_word(0) == 0xF0);
+    assert(av.popcount(0, 64) == 4);
+}
+
+// Counters updated by many threads, one at a time and through buffers,
+// checked against the sequential sums
+void test_atomic_packed_view(size_t width)
+{
+    const size_t N = 1000;
+    const size_t nthreads = 4;
+    const size_t updates = 20000;
+    
+    packed_view<std::vector> v(width, N);
+    atomic_packed_view<std::vector> av(v);
+    
+    using opt = atomic_packed_view<std::vector>::overflow_opt;
+    
+    std::vector<std::thread> threads;
+    for(size_t t = 0; t < nthreads; ++t)
+        threads.emplace_back([&, t] {
+            std::mt19937_64 engine(t);
+            atomic_packed_view<std::vector>::buffer buf(av, 100,
+                                                        opt::may_overflow);
+            
+            for(size_t k = 0; k < updates; ++k) {
+                size_t i = engine() % 64;
+                if(t % 2)
+                    av.fetch_add(i, 1, opt::may_overflow,
+                                 std::memory_order_relaxed);
+                else
+                    buf.add(i, 1);
+            }
+        });
+    
+    for(std::thread &t : threads)
+        t.join();
+    
+    std::vector<uint64_t> ref(N);
+    for(size_t t = 0; t < nthreads; ++t) {
+        std::mt19937_64 engine(t);
+        for(size_t k = 0; k < updates; ++k)
+            ++ref[engine() % 64];
+    }
+    
+    for(size_t i = 0; i < N; ++i) {
+        assert(v[i] == bv::internal::lowbits(ref[i], width));
+        assert(av.load(i) == v[i]);
+    }
+    
+    // Saturation and wrapping at the ends of the range of the fields
+    av.fetch_sub(100, av.load(100));
+    assert(av.fetch_add(100, av.max() - 1) == 0);
+    assert(av.fetch_add(100, 5, opt::saturate) == av.max() - 1);
+    assert(av.load(100) == av.max());
+    assert(av.fetch_add(100, 2, opt::may_overflow) == av.max());
+    assert(av.load(100) == 1);
+    assert(av.fetch_sub(100, 3, opt::saturate) == 1);
+    assert(av.load(100) == 0);
+}
+
+void test_atomic_packed_view()
+{
+    for(size_t width : { 3, 12, 16, 20 })
+        test_atomic_packed_view(width);
+}
+
 template<typename T>
 using array4 = std::array<T, 4>;
 
@@ -184,14 +1008,35 @@ void test_bits()
     assert(w2.size() == 256);
     w2.set(0, 42, 42);
     assert(w2.get(0, 42) == 42);
+    
+    // Test other word types
+    bitarray<256, uint32_t> w3;
+    assert(w3.container().size() == 8);
+    w3.set(20, 50, 42);
+    assert(w3.get(20, 50) == 42);
 }
 
 int main()
 {    
-    //test_bits();
-    //test_word();
+    test_bits();
+    test_word();
+    test_copy();
+    test_logic();
+    test_gather();
+    test_rank_select();
+    test_buffer_view();
+    test_mmap_vector();
+    test_atomic_bitview();
+    test_atomic_packed_view();
     test_packed_view();
-    //test_bitvector();
+    test_packed_arith();
+    test_packed_bulk();
+    test_packed_array();
+    test_packed_sort();
+    test_packed_repack();
+    test_bitvector();
+    test_bitvector_report();
+    test_bitvector_instrumentation();
     
     return 0;
 }
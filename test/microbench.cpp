@@ -0,0 +1,334 @@
+/*
+ * Copyright 2014 Nicola Gigante
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "bench.h"
+
+#include "bitview.h"
+#include "packed_view.h"
+
+#include <array>
+#include <deque>
+#include <vector>
+#include <random>
+#include <string>
+#include <functional>
+#include <type_traits>
+
+using namespace bv;
+
+/*
+ * Microbenchmarks of the kernels the bitvector is built upon, in isolation:
+ * the bitmasking functions of bits.h and the operations of bitview and
+ * packed_view on the leaves and nodes.
+ *
+ * The views are 4096 bits long, the size of a node, so they stay in the L1
+ * cache and the numbers don't depend on the memory hierarchy. Each kernel
+ * runs for each container type, and where it matters, for a few widths and
+ * for ranges aligned to words or split between two of them. --size sets
+ * the number of operations of each benchmark.
+ */
+
+constexpr size_t Bits = 4096;
+
+// Number of precomputed arguments, cycled by the benchmarks
+constexpr size_t Args = 4096;
+
+using fixed_array = internal::bitarray_t<Bits>;
+
+// Makes a container of the given number of words, zeroed. Containers
+// without a size constructor, like std::array, have a fixed size.
+template<typename C>
+C make_container(size_t words, std::true_type) {
+    return C(words);
+}
+
+template<typename C>
+C make_container(size_t, std::false_type) {
+    return C{};
+}
+
+template<typename C>
+C make_container(size_t words) {
+    return make_container<C>(words, std::is_constructible<C, size_t>());
+}
+
+template<template<typename ...> class C>
+bitview<C> make_bitview(std::mt19937_64 &engine)
+{
+    using container_type = typename bitview<C>::container_type;
+    
+    bitview<C> bits(make_container<container_type>(Bits / 64));
+    for(size_t i = 0; i < bits.container().size(); ++i)
+        bits.container()[i] = engine();
+    
+    return bits;
+}
+
+/*
+ * Beginnings of ranges of len bits. Aligned ranges begin at a word, split
+ * ones straddle two words, or begin in the middle of one if they are
+ * longer than a word.
+ */
+std::vector<size_t> range_begins(size_t len, bool split,
+                                 std::mt19937_64 &engine)
+{
+    std::vector<size_t> begins(Args);
+    for(size_t &b : begins) {
+        b = engine() % ((Bits - len) / 64) * 64;
+        if(split)
+            b += 64 - (len < 64 ? len / 2 : 29);
+    }
+    
+    return begins;
+}
+
+void bits_kernels(bench::suite &suite, std::mt19937_64 &engine)
+{
+    using internal::mask;
+    
+    const size_t N = suite.opts().size;
+    
+    // Random ranges inside a word, and the words to extract them from
+    std::vector<size_t> begins(Args), ends(Args);
+    std::vector<uint64_t> words(Args);
+    for(size_t k = 0; k < Args; ++k) {
+        begins[k] = engine() % 64;
+        ends[k] = begins[k] + engine() % (65 - begins[k]);
+        words[k] = engine();
+    }
+    
+    auto nothing = [] { return 0; };
+    
+    suite.run("bits/mask", N, nothing, [&](int) {
+        uint64_t x = 0;
+        for(size_t k = 0; k < N; ++k)
+            x ^= mask<uint64_t>(begins[k % Args], ends[k % Args]);
+        bench::do_not_optimize(x);
+    });
+    
+    suite.run("bits/lowbits", N, nothing, [&](int) {
+        uint64_t x = 0;
+        for(size_t k = 0; k < N; ++k)
+            x ^= internal::lowbits(words[k % Args], ends[k % Args]);
+        bench::do_not_optimize(x);
+    });
+    
+    suite.run("bits/highbits", N, nothing, [&](int) {
+        uint64_t x = 0;
+        for(size_t k = 0; k < N; ++k)
+            x ^= internal::highbits(words[k % Args], ends[k % Args]);
+        bench::do_not_optimize(x);
+    });
+    
+    suite.run("bits/bitfield", N, nothing, [&](int) {
+        uint64_t x = 0;
+        for(size_t k = 0; k < N; ++k)
+            x ^= internal::bitfield(words[k % Args],
+                                    begins[k % Args], ends[k % Args]);
+        bench::do_not_optimize(x);
+    });
+    
+    suite.run("bits/set_bitfield", N, nothing, [&](int) {
+        uint64_t x = 0;
+        for(size_t k = 0; k < N; ++k)
+            internal::set_bitfield(x, begins[k % Args], ends[k % Args],
+                                   words[k % Args]);
+        bench::do_not_optimize(x);
+    });
+}
+
+template<template<typename ...> class C>
+void bitview_kernels(bench::suite &suite, std::string const&cname,
+                     std::mt19937_64 &engine)
+{
+    const size_t N = suite.opts().size;
+    
+    bitview<C> bits = make_bitview<C>(engine);
+    bitview<C> other = make_bitview<C>(engine);
+    
+    auto shared = [&] { return std::ref(bits); };
+    
+    for(bool split : { false, true })
+    {
+        std::string offset = split ? "/split/" : "/aligned/";
+        
+        for(size_t width : { 8, 33, 64 })
+        {
+            std::vector<size_t> begins = range_begins(width, split, engine);
+            std::string w = "/w" + std::to_string(width);
+            
+            suite.run("bitview/get" + w + offset + cname, N, N * width / 8,
+                      shared, [&](bitview<C> &b) {
+                uint64_t x = 0;
+                for(size_t k = 0; k < N; ++k) {
+                    size_t p = begins[k % Args];
+                    x ^= b.get(p, p + width);
+                }
+                bench::do_not_optimize(x);
+            });
+            
+            suite.run("bitview/set" + w + offset + cname, N, N * width / 8,
+                      shared, [&](bitview<C> &b) {
+                for(size_t k = 0; k < N; ++k) {
+                    size_t p = begins[k % Args];
+                    b.set(p, p + width, internal::lowbits(uint64_t(k), width));
+                }
+            });
+        }
+        
+        // Ranges longer than a word. Split copies go between ranges with
+        // different offsets in the words.
+        const size_t len = 1024;
+        std::vector<size_t> begins = range_begins(len, split, engine);
+        std::vector<size_t> dests = range_begins(len, false, engine);
+        for(size_t &d : dests)
+            d += split ? 13 : 0;
+        
+        suite.run("bitview/popcount" + offset + cname, N, N * len / 8,
+                  shared, [&](bitview<C> &b) {
+            size_t count = 0;
+            for(size_t k = 0; k < N; ++k) {
+                size_t p = begins[k % Args];
+                count += b.popcount(p, p + len);
+            }
+            bench::do_not_optimize(count);
+        });
+        
+        suite.run("bitview/copy" + offset + cname, N, N * len / 8,
+                  shared, [&](bitview<C> &b) {
+            for(size_t k = 0; k < N; ++k) {
+                size_t s = begins[k % Args];
+                size_t d = dests[k % Args];
+                b.copy(other, s, s + len, d, d + len);
+            }
+        });
+    }
+    
+    // Insertions shift the rest of the view, so the bytes processed are
+    // the ones after the insertion point
+    std::vector<size_t> positions(Args);
+    for(size_t &p : positions)
+        p = engine() % (Bits - 64);
+    
+    for(size_t width : { 1, 13, 64 })
+    {
+        size_t bytes = 0;
+        for(size_t k = 0; k < N; ++k)
+            bytes += (Bits - positions[k % Args]) / 8;
+        
+        suite.run("bitview/insert/w" + std::to_string(width) + "/" + cname,
+                  N, bytes, shared, [&](bitview<C> &b) {
+            for(size_t k = 0; k < N; ++k) {
+                size_t p = positions[k % Args];
+                b.insert(p, p + width,
+                         internal::lowbits(uint64_t(k), width));
+            }
+        });
+    }
+}
+
+constexpr size_t gcd(size_t a, size_t b) {
+    return b == 0 ? a : gcd(b, a % b);
+}
+
+template<template<typename ...> class C>
+void packed_view_kernels(bench::suite &suite, std::string const&cname,
+                         std::mt19937_64 &engine)
+{
+    using container_type = typename packed_view<C>::container_type;
+    
+    const size_t N = suite.opts().size;
+    
+    for(size_t width : { 4, 12, 16, 20 })
+    {
+        const size_t size = Bits / width;
+        const uint64_t max = internal::lowbits(~uint64_t(0), width);
+        std::string w = "/w" + std::to_string(width);
+        
+        packed_view<C> fields(width, size,
+                              make_container<container_type>(Bits / 64));
+        auto shared = [&] { return std::ref(fields); };
+        
+        // The fields start from the middle of the range, so they never
+        // overflow, since increments and decrements alternate
+        fields.transform(0, size, [&](uint64_t) {
+            return max / 2;
+        });
+        
+        // Ranges of the fields of a few words. Aligned ranges begin at a
+        // word, split ones a field later.
+        const size_t len = 64 * 4 / width;
+        const size_t step = 64 / gcd(64, width);
+        for(bool split : { false, true })
+        {
+            std::string offset = split ? "/split/" : "/aligned/";
+            
+            std::vector<size_t> begins(Args);
+            for(size_t &b : begins)
+                b = engine() % ((size - len - 1) / step) * step + split;
+            
+            suite.run("packed_view/increment" + w + offset + cname, N,
+                      N * len * width / 8, shared, [&](packed_view<C> &v) {
+                for(size_t k = 0; k < N; ++k) {
+                    size_t b = begins[k / 2 % Args];
+                    if(k % 2 == 0)
+                        v.increment(b, b + len, 1);
+                    else
+                        v.decrement(b, b + len, 1);
+                }
+            });
+        }
+        
+        // The search done by bitvector's find_insert_point(): the number of
+        // counters of a node less than an index, in a node of sorted sums
+        fields.transform(0, size, [&](uint64_t) { return 0; });
+        for(size_t i = 0; i < size; ++i)
+            fields.set(i, i * max / size);
+        
+        std::vector<uint64_t> values(Args);
+        for(uint64_t &v : values)
+            v = engine() % max;
+        
+        suite.run("packed_view/count_less" + w + "/" + cname, N,
+                  N * Bits / 8, shared, [&](packed_view<C> &v) {
+            size_t count = 0;
+            for(size_t k = 0; k < N; ++k)
+                count += v.count_less(0, size, values[k % Args]);
+            bench::do_not_optimize(count);
+        });
+    }
+}
+
+template<template<typename ...> class C>
+void kernels(bench::suite &suite, std::string const&cname,
+             std::mt19937_64 &engine)
+{
+    bitview_kernels<C>(suite, cname, engine);
+    packed_view_kernels<C>(suite, cname, engine);
+}
+
+int main(int argc, char **argv)
+{
+    bench::suite suite(argc, argv);
+    
+    std::mt19937_64 engine(42);
+    
+    bits_kernels(suite, engine);
+    
+    kernels<std::vector>(suite, "vector", engine);
+    kernels<std::deque>(suite, "deque", engine);
+    kernels<fixed_array::array>(suite, "array", engine);
+}
@@ -0,0 +1,199 @@
+/*
+ * Copyright 2014 Nicola Gigante
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PACKED_BITVECTOR_PERF_COUNTERS_H
+#define PACKED_BITVECTOR_PERF_COUNTERS_H
+
+#include <array>
+#include <string>
+#include <cstring>
+#include <cstdint>
+
+#if defined(__linux__)
+#include <cerrno>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+namespace bench
+{
+    /*
+     * Hardware performance counters of the calling thread, read with the
+     * perf_event_open() system call of Linux, for the user space code only.
+     *
+     * Each counter is opened on its own, so the ones the CPU or the kernel
+     * don't support are simply missing. They are all missing on other
+     * systems, in virtual machines without a PMU, or if perf events are
+     * forbidden by /proc/sys/kernel/perf_event_paranoid. If the counters
+     * are more than the hardware registers, the kernel multiplexes them,
+     * and the counts are scaled to the whole measured time.
+     */
+    class perf_counters
+    {
+    public:
+        static constexpr size_t count = 5;
+        
+        using values = std::array<double, count>;
+        
+        static char const*name(size_t i) {
+            static char const*names[count] = {
+                "l1d_misses", "llc_misses", "dtlb_misses",
+                "branch_misses", "instructions"
+            };
+            return names[i];
+        }
+        
+        // Opens the counters, if enabled
+        explicit perf_counters(bool enabled = true);
+        
+        ~perf_counters();
+        
+        perf_counters(perf_counters const&) = delete;
+        perf_counters &operator=(perf_counters const&) = delete;
+        
+        bool available(size_t i) const { return _fds[i] >= 0; }
+        
+        bool any() const {
+            for(size_t i = 0; i < count; ++i)
+                if(available(i))
+                    return true;
+            return false;
+        }
+        
+        // Why the first missing counter couldn't be opened
+        std::string const&error() const { return _error; }
+        
+        // Reset and start the counters, and stop them
+        void start();
+        void stop();
+        
+        // Counts between start() and stop(), negative for missing counters
+        values read() const;
+    
+    private:
+        std::array<int, count> _fds;
+        std::string _error;
+    };
+
+#if defined(__linux__)
+
+    inline perf_counters::perf_counters(bool enabled)
+    {
+        _fds.fill(-1);
+        if(!enabled)
+            return;
+        
+        auto cache = [](uint64_t cache) {
+            return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                           (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        };
+        
+        const std::pair<uint32_t, uint64_t> events[count] = {
+            { PERF_TYPE_HW_CACHE, cache(PERF_COUNT_HW_CACHE_L1D)  },
+            { PERF_TYPE_HW_CACHE, cache(PERF_COUNT_HW_CACHE_LL)   },
+            { PERF_TYPE_HW_CACHE, cache(PERF_COUNT_HW_CACHE_DTLB) },
+            { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES     },
+            { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS      }
+        };
+        
+        for(size_t i = 0; i < count; ++i)
+        {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = events[i].first;
+            attr.config = events[i].second;
+            attr.disabled = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+                               PERF_FORMAT_TOTAL_TIME_RUNNING;
+            
+            _fds[i] = int(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+            if(_fds[i] < 0 && _error.empty())
+                _error = std::string(name(i)) + ": " + std::strerror(errno);
+        }
+    }
+    
+    inline perf_counters::~perf_counters()
+    {
+        for(int fd : _fds)
+            if(fd >= 0)
+                close(fd);
+    }
+    
+    inline void perf_counters::start()
+    {
+        for(int fd : _fds)
+            if(fd >= 0) {
+                ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+                ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+            }
+    }
+    
+    inline void perf_counters::stop()
+    {
+        for(int fd : _fds)
+            if(fd >= 0)
+                ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    }
+    
+    inline perf_counters::values perf_counters::read() const
+    {
+        values result;
+        result.fill(-1);
+        
+        for(size_t i = 0; i < count; ++i)
+        {
+            // The count, the time enabled and the time actually counting
+            uint64_t data[3];
+            if(!available(i) ||
+               ::read(_fds[i], data, sizeof(data)) != sizeof(data) ||
+               data[2] == 0)
+                continue;
+            
+            result[i] = double(data[0]) * data[1] / data[2];
+        }
+        
+        return result;
+    }
+
+#else
+
+    inline perf_counters::perf_counters(bool enabled)
+    {
+        _fds.fill(-1);
+        if(enabled)
+            _error = "performance counters are supported only on Linux";
+    }
+    
+    inline perf_counters::~perf_counters() { }
+    inline void perf_counters::start() { }
+    inline void perf_counters::stop() { }
+    
+    inline perf_counters::values perf_counters::read() const {
+        values result;
+        result.fill(-1);
+        return result;
+    }
+
+#endif
+
+} // namespace bench
+
+#endif
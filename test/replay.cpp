@@ -0,0 +1,168 @@
+/*
+ * Copyright 2014 Nicola Gigante
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "bench.h"
+#include "workloads.h"
+
+#include "bitvector.h"
+#include "trace.h"
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <iostream>
+
+using namespace bv;
+
+/*
+ * Replays a trace recorded by bitvector_t::trace() (see trace.h) with
+ * timing, for each configuration of leaf width, node width and allocation
+ * policy given by --leaf-widths, --node-widths and --policies, which
+ * default to the configuration the trace was recorded with.
+ *
+ * Each configuration starts from the bits the trace begins with, and is
+ * reported as a benchmark of the whole trace, and with the latencies of
+ * each kind of operation. --size is ignored.
+ */
+
+const std::vector<std::string> op_names = { "access", "rank", "set", "insert" };
+
+struct trace_t {
+    trace_header header;
+    std::vector<trace_record> records;
+};
+
+// Loads the trace, checking that every operation is valid for the size
+// of the bitvector at that point
+trace_t load(std::string const&path)
+{
+    std::ifstream in(path, std::ios::binary);
+    trace_reader reader(in);
+    if(!reader.valid()) {
+        std::cerr << "Can't read a trace from " << path << "\n";
+        std::exit(1);
+    }
+    
+    trace_t t = { reader.header(), { } };
+    
+    size_t size = t.header.initial.size();
+    for(trace_record r; reader.next(r);)
+    {
+        bool valid = r.op == trace_op::rank || r.op == trace_op::insert
+                   ? r.index <= size : r.index < size;
+        if(r.op == trace_op::insert)
+            valid = valid && size++ < t.header.capacity;
+        
+        if(!valid) {
+            std::cerr << "Invalid operation " << t.records.size()
+                      << " in the trace: " << op_names[size_t(r.op)]
+                      << " at " << r.index << "\n";
+            std::exit(1);
+        }
+        
+        t.records.push_back(r);
+    }
+    
+    return t;
+}
+
+template<size_t W, allocation_policy_t AP>
+void replay(bench::suite &suite, trace_t const&t, size_t Wn,
+            std::string const&policy)
+{
+    using bitvector_type = bitvector_t<W, AP>;
+    
+    if(!bitvector_type::valid_node_width(t.header.capacity, Wn)) {
+        std::cerr << "Skipping W = " << W << ", Wn = " << Wn
+                  << ": nodes too narrow for the capacity\n";
+        return;
+    }
+    
+    auto setup = [&] {
+        bitvector_type v(t.header.capacity, Wn);
+        for(bool bit : t.header.initial)
+            v.push_back(bit);
+        return v;
+    };
+    
+    std::string config = "W=" + std::to_string(W) +
+                         "/Wn=" + std::to_string(Wn) + "/" + policy;
+    
+    suite.run("replay/" + config, t.records.size(), setup,
+              [&](bitvector_type &v) {
+        size_t x = 0;
+        for(trace_record const&r : t.records)
+            bench::apply(v, r, x);
+        bench::do_not_optimize(x);
+    });
+    
+    suite.run_latency("latency/" + config, op_names, setup,
+                      [&](bitvector_type &v, bench::latency_recorder &l) {
+        size_t x = 0;
+        for(trace_record const&r : t.records)
+            l.time(size_t(r.op), [&] { bench::apply(v, r, x); });
+        bench::do_not_optimize(x);
+    });
+}
+
+// The leaf widths must be known at compile time
+template<allocation_policy_t AP>
+void replay(bench::suite &suite, trace_t const&t, size_t W, size_t Wn,
+            std::string const&policy)
+{
+    switch(W) {
+        case 256:  replay<256, AP>(suite, t, Wn, policy);  break;
+        case 512:  replay<512, AP>(suite, t, Wn, policy);  break;
+        case 1024: replay<1024, AP>(suite, t, Wn, policy); break;
+        case 2048: replay<2048, AP>(suite, t, Wn, policy); break;
+        case 4096: replay<4096, AP>(suite, t, Wn, policy); break;
+        default:
+            std::cerr << "Skipping W = " << W << ": only 256, 512, 1024, "
+                      << "2048 and 4096 are compiled in\n";
+    }
+}
+
+int main(int argc, char **argv)
+{
+    bench::suite suite(argc, argv,
+                       { "trace", "leaf-widths", "node-widths", "policies" });
+    bench::options const&opts = suite.opts();
+    
+    std::string path = opts.param("trace", "");
+    if(path.empty()) {
+        std::cerr << "Usage: " << argv[0] << " --trace=file [--leaf-widths=W,..]"
+                  << " [--node-widths=Wn,..] [--policies=demand,immediate]"
+                  << " [benchmark options]\n";
+        return 1;
+    }
+    
+    trace_t t = load(path);
+    
+    std::vector<size_t> leaf_widths = bench::parse_list(
+        opts.param("leaf-widths", std::to_string(t.header.leaf_width)));
+    std::vector<size_t> node_widths = bench::parse_list(
+        opts.param("node-widths", std::to_string(t.header.node_width)));
+    std::string policies = opts.param("policies", "demand");
+    
+    for(size_t W : leaf_widths)
+        for(size_t Wn : node_widths)
+        {
+            if(policies.find("demand") != std::string::npos)
+                replay<alloc_on_demand>(suite, t, W, Wn, "demand");
+            if(policies.find("immediate") != std::string::npos)
+                replay<alloc_immediatly>(suite, t, W, Wn, "immediate");
+        }
+}
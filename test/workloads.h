@@ -0,0 +1,300 @@
+/*
+ * Copyright 2014 Nicola Gigante
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PACKED_BITVECTOR_WORKLOADS_H
+#define PACKED_BITVECTOR_WORKLOADS_H
+
+#include "trace.h"
+
+#include <cmath>
+#include <string>
+#include <vector>
+#include <random>
+#include <numeric>
+#include <fstream>
+#include <algorithm>
+
+/*
+ * Generators of the workloads of the benchmarks, modeled on the access
+ * patterns of real uses of dynamic bitvectors.
+ *
+ * Insertions are generated as the positions of n insertions in a vector
+ * of 'initial' bits, each one valid for the size at that point. Workloads
+ * with reads are generated as sequences of operations, the same recorded
+ * in traces, to be performed with apply().
+ */
+namespace bench
+{
+    using operation = bv::trace_record;
+    using bv::trace_op;
+    
+    // Performs the operation on v, adding the results of queries to x
+    template<typename Bitvector>
+    void apply(Bitvector &v, operation const&op, size_t &x)
+    {
+        switch(op.op) {
+            case trace_op::access: x += v.access(op.index);        break;
+            case trace_op::rank:   x += v.rank(op.index, op.bit);  break;
+            case trace_op::set:    v.set(op.index, op.bit);        break;
+            case trace_op::insert: v.insert(op.index, op.bit);     break;
+        }
+    }
+    
+    // Each insertion uniformly distributed over the current size
+    inline std::vector<size_t>
+    uniform_positions(size_t n, std::mt19937_64 &engine, size_t initial = 0)
+    {
+        std::vector<size_t> positions(n);
+        for(size_t i = 0; i < n; ++i)
+            positions[i] = engine() % (initial + i + 1);
+        
+        return positions;
+    }
+    
+    /*
+     * Bursts of insertions close to a cursor doing a random walk, as when
+     * editing a region at a time. The cursor jumps to a random position
+     * once every 'burst' insertions on average.
+     */
+    inline std::vector<size_t>
+    clustered_positions(size_t n, std::mt19937_64 &engine, size_t initial = 0,
+                        size_t burst = 1024)
+    {
+        std::vector<size_t> positions(n);
+        
+        size_t cursor = initial;
+        for(size_t i = 0; i < n; ++i)
+        {
+            size_t size = initial + i;
+            if(engine() % burst == 0)
+                cursor = engine() % (size + 1);
+            
+            size_t jitter = engine() % 64;
+            cursor = std::min(cursor + jitter / 2, size);
+            positions[i] = cursor - std::min(cursor, jitter % 8);
+        }
+        
+        return positions;
+    }
+    
+    /*
+     * Insertions in a few hot regions. The vector is split in 'regions'
+     * regions, which are chosen with a Zipf distribution of exponent s, so
+     * the k-th hottest one is chosen with probability proportional to
+     * 1/k^s. The hottest regions are scattered over the vector, and the
+     * insertions are uniform inside a region.
+     */
+    inline std::vector<size_t>
+    zipf_positions(size_t n, std::mt19937_64 &engine, size_t initial = 0,
+                   size_t regions = 1024, double s = 1.0)
+    {
+        std::vector<double> weights(regions);
+        for(size_t k = 0; k < regions; ++k)
+            weights[k] = 1 / std::pow(double(k + 1), s);
+        std::discrete_distribution<size_t> zipf(weights.begin(),
+                                                weights.end());
+        
+        std::vector<size_t> hot(regions);
+        std::iota(hot.begin(), hot.end(), 0);
+        std::shuffle(hot.begin(), hot.end(), engine);
+        
+        std::uniform_real_distribution<double> offset(0, 1);
+        
+        std::vector<size_t> positions(n);
+        for(size_t i = 0; i < n; ++i) {
+            double x = (hot[zipf(engine)] + offset(engine)) / regions;
+            positions[i] = std::min(size_t(x * (initial + i + 1)), initial + i);
+        }
+        
+        return positions;
+    }
+    
+    // Appends, with a fraction of insertions uniformly in the middle
+    inline std::vector<size_t>
+    append_heavy_positions(size_t n, std::mt19937_64 &engine,
+                           size_t initial = 0, double middle = 0.01)
+    {
+        std::bernoulli_distribution in_middle(middle);
+        
+        std::vector<size_t> positions(n);
+        for(size_t i = 0; i < n; ++i)
+            positions[i] = in_middle(engine) ? engine() % (initial + i + 1)
+                                             : initial + i;
+        
+        return positions;
+    }
+    
+    /*
+     * Suffix array of the text, by prefix doubling. Simple rather than
+     * fast, but fine for the sizes of the benchmarks.
+     */
+    inline std::vector<size_t> suffix_array(std::string const&text)
+    {
+        const size_t n = text.size();
+        
+        std::vector<size_t> sa(n), rank(n), tmp(n);
+        std::iota(sa.begin(), sa.end(), 0);
+        for(size_t i = 0; i < n; ++i)
+            rank[i] = (unsigned char)text[i];
+        
+        for(size_t k = 1; n > 0; k *= 2)
+        {
+            // Suffixes ordered by their first 2k characters
+            auto key = [&](size_t i) {
+                return std::make_pair(rank[i], i + k < n ? rank[i + k] + 1 : 0);
+            };
+            std::sort(sa.begin(), sa.end(), [&](size_t a, size_t b) {
+                return key(a) < key(b);
+            });
+            
+            tmp[sa[0]] = 0;
+            for(size_t i = 1; i < n; ++i)
+                tmp[sa[i]] = tmp[sa[i - 1]] + (key(sa[i - 1]) < key(sa[i]));
+            rank.swap(tmp);
+            
+            if(rank[sa[n - 1]] == n - 1)
+                break;
+        }
+        
+        return sa;
+    }
+    
+    /*
+     * The insertions done by the construction of the BWT of the text with a
+     * dynamic string, from the end of the text to its beginning, as in
+     * dynamic FM-indexes. Each character goes to the position of the new
+     * suffix among the suffixes inserted so far, found with a step of the
+     * LF mapping, so the positions follow the LF walk over the text.
+     *
+     * The bitvector gets the bits of the root of the wavelet tree of the
+     * string, i.e. if each character is in the upper half of the alphabet.
+     */
+    inline std::vector<operation> lf_walk(std::string const&text)
+    {
+        const size_t n = text.size();
+        
+        std::vector<size_t> sa = suffix_array(text);
+        std::vector<size_t> rank(n);
+        for(size_t i = 0; i < n; ++i)
+            rank[sa[i]] = i;
+        
+        // The alphabet split of the root of the wavelet tree
+        std::vector<unsigned char> letters(text.begin(), text.end());
+        std::sort(letters.begin(), letters.end());
+        letters.erase(std::unique(letters.begin(), letters.end()),
+                      letters.end());
+        unsigned char split = letters.empty() ? 0
+                                              : letters[letters.size() / 2];
+        
+        // Fenwick tree of the ranks of the inserted suffixes, to count the
+        // ones less than the new suffix
+        std::vector<size_t> tree(n + 1, 0);
+        
+        std::vector<operation> ops(n);
+        for(size_t k = 0; k < n; ++k)
+        {
+            size_t i = n - 1 - k;
+            
+            size_t smaller = 0;
+            for(size_t j = rank[i]; j > 0; j -= j & -j)
+                smaller += tree[j];
+            for(size_t j = rank[i] + 1; j <= n; j += j & -j)
+                tree[j] += 1;
+            
+            ops[k] = { trace_op::insert, smaller,
+                       (unsigned char)text[i] >= split };
+        }
+        
+        return ops;
+    }
+    
+    /*
+     * A synthetic text of n characters of an alphabet of sigma letters,
+     * made of copies of a random block with a fraction of mutations, like
+     * versions of a document or genomes of the same species, which are the
+     * typical texts of dynamic FM-indexes.
+     */
+    inline std::string repetitive_text(size_t n, std::mt19937_64 &engine,
+                                       size_t sigma = 4, size_t block = 10000,
+                                       double mutations = 0.001)
+    {
+        std::string base(std::min(n, block), 0);
+        for(char &c : base)
+            c = char('a' + engine() % sigma);
+        
+        std::bernoulli_distribution mutate(mutations);
+        
+        std::string text(n, 0);
+        for(size_t i = 0; i < n; ++i)
+            text[i] = mutate(engine) ? char('a' + engine() % sigma)
+                                     : base[i % base.size()];
+        
+        return text;
+    }
+    
+    // Up to n characters of a file, or an empty string if it can't be read
+    inline std::string read_text(std::string const&path, size_t n)
+    {
+        std::ifstream in(path, std::ios::binary);
+        std::string text(n, 0);
+        in.read(&text[0], std::streamsize(n));
+        text.resize(size_t(in.gcount()));
+        
+        return text;
+    }
+    
+    // Insertions of random bits at the given positions
+    inline std::vector<operation>
+    insertions(std::vector<size_t> const&positions, std::mt19937_64 &engine)
+    {
+        std::vector<operation> ops(positions.size());
+        for(size_t i = 0; i < positions.size(); ++i)
+            ops[i] = { trace_op::insert, positions[i], bool(engine() % 2) };
+        
+        return ops;
+    }
+    
+    /*
+     * Interleaves reads with the writes, so that a fraction 'reads' of the
+     * operations are reads, half access() and half rank(), uniformly
+     * distributed over the size of the vector at that point. The vector
+     * has 'initial' bits before the writes.
+     */
+    inline std::vector<operation>
+    with_reads(std::vector<operation> const&writes, double reads,
+               std::mt19937_64 &engine, size_t initial = 0)
+    {
+        std::bernoulli_distribution is_read(reads);
+        
+        std::vector<operation> ops;
+        size_t size = initial;
+        for(size_t w = 0; w < writes.size();)
+        {
+            if(size > 0 && is_read(engine)) {
+                trace_op op = engine() % 2 ? trace_op::access : trace_op::rank;
+                ops.push_back({ op, engine() % size, true });
+            } else {
+                size += writes[w].op == trace_op::insert;
+                ops.push_back(writes[w++]);
+            }
+        }
+        
+        return ops;
+    }
+
+} // namespace bench
+
+#endif